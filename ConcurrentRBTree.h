@@ -0,0 +1,187 @@
+#ifndef CONCURRENT_RBTREE_LIB_H
+#define CONCURRENT_RBTREE_LIB_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+
+#include "RBTree.h"
+#include "PathCopy.h"
+
+// Concurrent_red_black_tree <K,V,Compare>:
+// K, V, Compare : as for Red_black_tree
+//
+// Read-mostly red black tree. Published nodes are never modified:
+// writers copy the path an insert or remove touches (copy on write),
+// then swing the root atomically. Readers therefore never lock and
+// always walk one consistent version of the tree.
+//
+// Writers are serialized by a mutex. Replaced nodes are retired and
+// freed once every reader that could still see them is gone
+// (epoch based reclamation). Readers announce themselves in one of
+// reader_slots (128) padded slots, so reads only touch shared cache lines
+// when they walk the tree. At most 128 reads (find, contains and read
+// calls) run at once, further readers wait for a slot to free up.
+template <typename K, typename V, typename Compare = std::less<K>> struct Concurrent_red_black_tree {
+
+    private:
+        struct Node;
+
+    public:
+
+    // Snapshot struct:
+    // ~ read access to the version pinned by read(). Pointers it hands
+    // out are only valid inside the read() call.
+    struct Snapshot {
+
+        // find:
+        // ~ the value at k, nullptr if k is not in the snapshot
+        const V* find(const K& k) const;
+
+        // for_each_in_range:
+        // ~ calls fn(key, val) for lo <= key < hi, in order
+        template <typename Fn>
+        void for_each_in_range(const K& lo, const K& hi, Fn&& fn) const;
+
+        // for_each:
+        // ~ calls fn(key, val) for every entry, in order
+        template <typename Fn>
+        void for_each(Fn&& fn) const;
+
+        private:
+            friend struct Concurrent_red_black_tree;
+
+            Snapshot(const Node* r, const Compare* c);
+
+            const Node* root;
+            const Compare* comp;
+    };
+
+    // constructor:
+    // ~ initializes an empty tree
+    Concurrent_red_black_tree();
+
+    // constructor overload 1:
+    // ~ nodes are allocated from blocks of the given memory resource
+    explicit Concurrent_red_black_tree(std::pmr::memory_resource* resource);
+
+    // destructor:
+    // ~ no reader may still be inside the tree
+    ~Concurrent_red_black_tree();
+
+    Concurrent_red_black_tree(const Concurrent_red_black_tree&) = delete;
+    Concurrent_red_black_tree& operator=(const Concurrent_red_black_tree&) = delete;
+
+    // insert:
+    // ~ adds k,v (replaces the value if k is there). Copies O(log n) nodes.
+    void insert(const K& k, const V& v);
+
+    // remove:
+    // ~ removes k, returns whether it was there
+    bool remove(const K& k);
+
+    // find:
+    // ~ lock free lookup, returns a copy of the value
+    std::optional<V> find(const K& k) const;
+
+    // contains:
+    // ~ lock free membership test
+    bool contains(const K& k) const;
+
+    // read:
+    // ~ pins the current version and calls fn(const Snapshot&) on it.
+    // Writers keep going meanwhile, the snapshot does not change. fn must
+    // not call find, contains or read of the same tree: the nested read
+    // needs a second slot, and with all of them held it would wait forever
+    // for the one its own caller keeps.
+    template <typename Fn>
+    decltype(auto) read(Fn&& fn) const;
+
+    private:
+
+        // Node struct:
+        // immutable once published. stamp is the write that built it,
+        // only that write may still modify it.
+        struct Node {
+            K key;
+            V val;
+            Node* left;
+            Node* right;
+            bool color;
+            std::uint64_t stamp;
+        };
+
+        // Reader_slot struct:
+        // epoch announced by the reader holding it, 0 when free.
+        // One cache line each so readers do not share lines.
+        struct alignas(64) Reader_slot {
+            std::atomic<std::uint64_t> epoch{0};
+        };
+
+        static constexpr std::size_t reader_slots = 128;
+
+        // Read_guard struct:
+        // claims a slot with the current epoch, frees it on destruction
+        struct Read_guard {
+            explicit Read_guard(const Concurrent_red_black_tree& tree);
+            ~Read_guard();
+
+            Reader_slot* slot;
+        };
+
+        // Retired struct:
+        // a node unlinked by the write that published epoch
+        struct Retired {
+            Node* node;
+            std::uint64_t epoch;
+        };
+
+        // Write struct:
+        // state of the write in progress: its stamp and what it replaced.
+        // A node with this stamp is reused, any other one is copied and
+        // the original retired (see Path_copy).
+        struct Write {
+            Concurrent_red_black_tree* tree;
+            std::uint64_t stamp;
+            std::deque<Node*> replaced;
+
+            Node* make(bool c, Node* l, Node* y, Node* r);
+            Node* make_valued(Node* l, Node* y, Node* r, const V& v);
+            Node* make_leaf(const K& k, const V& v);
+            void unlink(Node* N);
+        };
+
+        using Ops = Path_copy<K, V, Compare, Node, Write>;
+
+        std::atomic<Node*> root;
+        std::atomic<std::uint64_t> epoch;
+        mutable Reader_slot slots[reader_slots];
+
+        // writer side state, guarded by write_lock
+        std::mutex write_lock;
+        std::uint64_t writes;
+        std::deque<Retired> retired;
+        Node_arena<Node> pool;
+        Compare comp;
+
+        // publish:
+        // swings the root, retires what the write replaced and frees what
+        // no reader can see anymore
+        void publish(Node* new_root, Write& w);
+
+        // reclaim:
+        // frees retired nodes older than every announced epoch
+        void reclaim();
+
+        // free_node, free_subtree: back to the arena
+        void free_node(Node* N);
+        void free_subtree(Node* N);
+};
+
+#include "ConcurrentRBTree.impl.h"
+#endif //CONCURRENT_RBTREE_LIB_H
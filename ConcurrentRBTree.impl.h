@@ -0,0 +1,216 @@
+#include "ConcurrentRBTree.h"
+
+#include <limits>
+#include <new>
+#include <thread>
+#include <type_traits>
+
+// Copy on write variant of the RBTree library.
+// Rebalancing lives in PathCopy.h, this file only decides how nodes
+// are built and when they are freed.
+
+
+// SNAPSHOT CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template<typename K, typename V, typename Compare>
+Concurrent_red_black_tree<K, V, Compare>::Snapshot::Snapshot(const Node* r, const Compare* c) : root(r), comp(c) {}
+
+template<typename K, typename V, typename Compare>
+const V* Concurrent_red_black_tree<K, V, Compare>::Snapshot::find(const K& k) const {
+    const Node* N = Ops::find(root, k, *comp);
+    return N ? &N->val : nullptr;
+}
+
+template<typename K, typename V, typename Compare>
+template <typename Fn>
+void Concurrent_red_black_tree<K, V, Compare>::Snapshot::for_each_in_range(const K& lo, const K& hi, Fn&& fn) const {
+    Ops::for_each_in_range(root, lo, hi, fn, *comp);
+}
+
+template<typename K, typename V, typename Compare>
+template <typename Fn>
+void Concurrent_red_black_tree<K, V, Compare>::Snapshot::for_each(Fn&& fn) const {
+    Ops::for_each(root, fn);
+}
+
+
+// EPOCH CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template<typename K, typename V, typename Compare>
+Concurrent_red_black_tree<K, V, Compare>::Read_guard::Read_guard(const Concurrent_red_black_tree& tree) {
+    // each thread remembers the slot it got last time, so in the common
+    // case the claim is one uncontended CAS on a line nobody else uses
+    static thread_local std::size_t hint = std::hash<std::thread::id>{}(std::this_thread::get_id());
+
+    std::size_t i = hint % reader_slots;
+    for (std::size_t tried = 1;; ++tried) {
+        // an epoch read a bit early only makes writers more careful
+        std::uint64_t now = tree.epoch.load();
+        std::uint64_t expected = 0;
+        if (tree.slots[i].epoch.compare_exchange_strong(expected, now)) break;
+        i = (i + 1) % reader_slots;
+        if (tried % reader_slots == 0) {
+            // a whole sweep found every slot held, let their readers run
+            std::this_thread::yield();
+        }
+    }
+    hint = i;
+    slot = &tree.slots[i];
+}
+
+template<typename K, typename V, typename Compare>
+Concurrent_red_black_tree<K, V, Compare>::Read_guard::~Read_guard() {
+    slot->epoch.store(0, std::memory_order_release);
+}
+
+template<typename K, typename V, typename Compare>
+void Concurrent_red_black_tree<K, V, Compare>::publish(Node* new_root, Write& w) {
+    // seq_cst all the way: a reader announcing itself after the epoch scan
+    // below is guaranteed to load new_root, never a node retired here
+    root.store(new_root);
+    std::uint64_t published = epoch.fetch_add(1);
+
+    for (Node* N : w.replaced) {
+        retired.push_back({N, published});
+    }
+    reclaim();
+}
+
+template<typename K, typename V, typename Compare>
+void Concurrent_red_black_tree<K, V, Compare>::reclaim() {
+    std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+    for (const Reader_slot& s : slots) {
+        std::uint64_t e = s.epoch.load();
+        if (e && e < oldest) oldest = e;
+    }
+
+    // a reader that announced e may still see what was retired at e
+    while (!retired.empty() && retired.front().epoch < oldest) {
+        free_node(retired.front().node);
+        retired.pop_front();
+    }
+}
+
+template<typename K, typename V, typename Compare>
+void Concurrent_red_black_tree<K, V, Compare>::free_node(Node* N) {
+    N->~Node();
+    pool.recycle(N);
+}
+
+template<typename K, typename V, typename Compare>
+void Concurrent_red_black_tree<K, V, Compare>::free_subtree(Node* N) {
+    if (!N) return;
+    free_subtree(N->left);
+    free_subtree(N->right);
+    free_node(N);
+}
+
+
+// CONCURRENT RED BLACK TREE CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template<typename K, typename V, typename Compare>
+Concurrent_red_black_tree<K, V, Compare>::Concurrent_red_black_tree()
+    : Concurrent_red_black_tree(std::pmr::get_default_resource()) {}
+
+template<typename K, typename V, typename Compare>
+Concurrent_red_black_tree<K, V, Compare>::Concurrent_red_black_tree(std::pmr::memory_resource* resource)
+    : root(nullptr), epoch(1), writes(0), pool(resource), comp() {}
+
+template<typename K, typename V, typename Compare>
+Concurrent_red_black_tree<K, V, Compare>::~Concurrent_red_black_tree() {
+    // the arena gives the blocks back anyway, only destructors need the walk
+    if constexpr (!std::is_trivially_destructible_v<Node>) {
+        free_subtree(root.load());
+        for (const Retired& r : retired) {
+            free_node(r.node);
+        }
+    }
+}
+
+template<typename K, typename V, typename Compare>
+std::optional<V> Concurrent_red_black_tree<K, V, Compare>::find(const K& k) const {
+    Read_guard guard(*this);
+    const Node* N = Ops::find(root.load(), k, comp);
+    if (!N) return std::nullopt;
+    return N->val;
+}
+
+template<typename K, typename V, typename Compare>
+bool Concurrent_red_black_tree<K, V, Compare>::contains(const K& k) const {
+    Read_guard guard(*this);
+    return Ops::find(root.load(), k, comp) != nullptr;
+}
+
+template<typename K, typename V, typename Compare>
+template <typename Fn>
+decltype(auto) Concurrent_red_black_tree<K, V, Compare>::read(Fn&& fn) const {
+    Read_guard guard(*this);
+    const Snapshot snapshot(root.load(), &comp);
+    return fn(snapshot);
+}
+
+template<typename K, typename V, typename Compare>
+void Concurrent_red_black_tree<K, V, Compare>::insert(const K& k, const V& v) {
+    std::lock_guard<std::mutex> lock(write_lock);
+
+    Write w{this, ++writes, {}};
+    Node* R = Ops::insert(w, root.load(std::memory_order_relaxed), k, v, comp);
+    publish(Ops::blacken(w, R), w);
+}
+
+template<typename K, typename V, typename Compare>
+bool Concurrent_red_black_tree<K, V, Compare>::remove(const K& k) {
+    std::lock_guard<std::mutex> lock(write_lock);
+
+    // a miss would still copy the whole path, so look first
+    Node* current = root.load(std::memory_order_relaxed);
+    if (!Ops::find(current, k, comp)) return false;
+
+    Write w{this, ++writes, {}};
+    Node* R = Ops::remove(w, current, k, comp);
+    publish(Ops::blacken(w, R), w);
+    return true;
+}
+
+
+// Path copying hooks ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template<typename K, typename V, typename Compare>
+typename Concurrent_red_black_tree<K, V, Compare>::Node*
+Concurrent_red_black_tree<K, V, Compare>::Write::make(bool c, Node* l, Node* y, Node* r) {
+    if (y->stamp == stamp) {
+        // built by this write, nobody else can see it yet
+        y->color = c;
+        y->left = l;
+        y->right = r;
+        return y;
+    }
+    Node* copy = new (tree->pool.allocate()) Node{y->key, y->val, l, r, c, stamp};
+    replaced.push_back(y);
+    return copy;
+}
+
+template<typename K, typename V, typename Compare>
+typename Concurrent_red_black_tree<K, V, Compare>::Node*
+Concurrent_red_black_tree<K, V, Compare>::Write::make_valued(Node* l, Node* y, Node* r, const V& v) {
+    if (y->stamp == stamp) {
+        y->val = v;
+        y->left = l;
+        y->right = r;
+        return y;
+    }
+    Node* copy = new (tree->pool.allocate()) Node{y->key, v, l, r, y->color, stamp};
+    replaced.push_back(y);
+    return copy;
+}
+
+template<typename K, typename V, typename Compare>
+typename Concurrent_red_black_tree<K, V, Compare>::Node*
+Concurrent_red_black_tree<K, V, Compare>::Write::make_leaf(const K& k, const V& v) {
+    return new (tree->pool.allocate()) Node{k, v, nullptr, nullptr, Ops::red, stamp};
+}
+
+template<typename K, typename V, typename Compare>
+void Concurrent_red_black_tree<K, V, Compare>::Write::unlink(Node* N) {
+    replaced.push_back(N);
+}
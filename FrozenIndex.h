@@ -0,0 +1,190 @@
+#ifndef FROZEN_INDEX_LIB_H
+#define FROZEN_INDEX_LIB_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "RBTree.h"
+
+// Frozen_index <K,V,Compare>:
+// K, V, Compare : as for Red_black_tree
+//
+// Immutable, read optimized copy of a Red_black_tree (see freeze()).
+// Entries sit in two sorted arrays, keys and values, so range scans are a
+// linear walk. Lookups go through a static B+ tree laid over the key array:
+// level 0 is the key array itself cut into blocks of block_keys keys, and
+// every level above holds the maximum of each block of the level below.
+// A lookup reads one block per level (a cache line for 4 byte keys) and
+// counts the keys less than the one searched, which is the child to take.
+// For 1M entries that is 5 blocks instead of about 20 scattered nodes.
+//
+// Arithmetic keys ordered by std::less count a whole block with AVX2 (or
+// SSE4.2) compares when the build enables them (-mavx2, -msse4.2,
+// -march=native), every other key with a branchless scalar loop.
+//
+// Pointer keys and values are borrowed from the tree the index was frozen
+// from: the index never releases them, so with owned ones (see Ownership)
+// it must not outlive that tree, and it cannot be thawed.
+template <typename K, typename V, typename Compare> struct Frozen_index {
+
+    // const_iterator:
+    // ~ random access over the entries in key order. Dereferencing gives
+    // a pair of references (first, second), so a range of it goes
+    // straight into Red_black_tree::from_sorted or assign_sorted.
+    struct const_iterator;
+
+    // constructor:
+    // ~ an empty index
+    Frozen_index();
+
+    // constructor overload 1:
+    // ~ an empty index ordered by comp
+    explicit Frozen_index(const Compare& comp);
+
+    // constructor overload 2:
+    // ~ copies the entries of tree, O(n). Red_black_tree::freeze() calls it.
+    template <bool Order_statistics, typename Aggregate>
+    explicit Frozen_index(const Red_black_tree<K, V, Compare, Order_statistics, Aggregate>& tree);
+
+    // from_sorted:
+    // ~ builds the index from the key value pairs (p.first, p.second) in
+    // [first, last), which must be strictly increasing by key. O(n)
+    template <typename It>
+    static Frozen_index from_sorted(It first, It last, const Compare& comp = Compare());
+
+    // size, empty:
+    std::size_t size() const;
+    bool empty() const;
+
+    // find:
+    // ~ the value at k, nullptr if k is not in the index
+    const V* find(const K& k) const;
+
+    // contains:
+    bool contains(const K& k) const;
+
+    // lower_bound:
+    // ~ position of the first key not less than k, size() if none
+    std::size_t lower_bound(const K& k) const;
+
+    // key_at, value_at:
+    // ~ the entry at a position, i < size()
+    const K& key_at(std::size_t i) const;
+    const V& value_at(std::size_t i) const;
+
+    // for_each_in_range:
+    // ~ calls fn(key, val) for lo <= key < hi, in order
+    template <typename Fn>
+    void for_each_in_range(const K& lo, const K& hi, Fn&& fn) const;
+
+    // for_each:
+    // ~ calls fn(key, val) for every entry, in order
+    template <typename Fn>
+    void for_each(Fn&& fn) const;
+
+    // begin, end:
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    // thaw:
+    // ~ a mutable tree with the same entries, built in O(n) by from_sorted.
+    // The tree gets a default constructed Compare; with a stateful one use
+    // tree.assign_sorted(index.begin(), index.end()) instead. Does not
+    // compile when K or V is owned: the tree and the one frozen would
+    // both release the same pointers.
+    Red_black_tree<K, V, Compare> thaw(unsigned threads = 1) const;
+
+    // Entry_ref struct:
+    // ~ what const_iterator points to
+    struct Entry_ref {
+        const K& first;
+        const V& second;
+
+        // lets it->first work on a proxy
+        const Entry_ref* operator->() const;
+    };
+
+    struct const_iterator {
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type        = std::pair<K, V>;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = Entry_ref;
+        using reference         = Entry_ref;
+
+        const_iterator() = default;
+
+        reference operator*() const;
+        pointer operator->() const;
+        reference operator[](difference_type d) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+        const_iterator& operator+=(difference_type d);
+        const_iterator& operator-=(difference_type d);
+        const_iterator operator+(difference_type d) const;
+        const_iterator operator-(difference_type d) const;
+        difference_type operator-(const const_iterator& other) const;
+
+        bool operator==(const const_iterator& other) const;
+        bool operator!=(const const_iterator& other) const;
+        bool operator<(const const_iterator& other) const;
+
+        private:
+            friend struct Frozen_index;
+
+            const_iterator(const Frozen_index* index, std::size_t i);
+
+            const Frozen_index* index = nullptr;
+            std::size_t i = 0;
+    };
+
+    private:
+
+        // keys per block: a cache line of 4 byte keys, two of 8 byte ones
+        static constexpr std::size_t block_keys = 16;
+
+        // Cache_aligned struct:
+        // allocator starting every array on a cache line, so no block
+        // straddles one more line than it has to
+        template <typename T> struct Cache_aligned {
+            using value_type = T;
+            Cache_aligned() = default;
+            template <typename U> Cache_aligned(const Cache_aligned<U>&) {}
+            T* allocate(std::size_t n);
+            void deallocate(T* p, std::size_t n);
+            template <typename U> bool operator==(const Cache_aligned<U>&) const { return true; }
+            template <typename U> bool operator!=(const Cache_aligned<U>&) const { return false; }
+        };
+
+        // every level, level 0 (the sorted keys, padded) first
+        std::vector<K, Cache_aligned<K>> keys;
+        // where each level starts in keys; levels.back() is a single block
+        std::vector<std::size_t> levels;
+        std::vector<V> vals;
+        std::size_t n = 0;
+        Compare comp;
+
+        // build:
+        // pads level 0 with copies of the greatest key and stacks the
+        // levels of block maxima on top of it, up to a single block
+        void build();
+
+        // block_rank:
+        // how many keys of the block are less than k, which for a sorted
+        // block is where k would go
+        std::size_t block_rank(const K* block, const K& k) const;
+
+        // vectorized:
+        // whether block_rank compares a whole block with SIMD instructions
+        static constexpr bool vectorized();
+};
+
+#include "FrozenIndex.impl.h"
+#endif //FROZEN_INDEX_LIB_H
@@ -0,0 +1,366 @@
+#include "FrozenIndex.h"
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+// BUILD CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template<typename K, typename V, typename Compare>
+template<typename T>
+T* Frozen_index<K, V, Compare>::Cache_aligned<T>::allocate(std::size_t n) {
+    return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(64)));
+}
+
+template<typename K, typename V, typename Compare>
+template<typename T>
+void Frozen_index<K, V, Compare>::Cache_aligned<T>::deallocate(T* p, std::size_t) {
+    ::operator delete(p, std::align_val_t(64));
+}
+
+template<typename K, typename V, typename Compare>
+Frozen_index<K, V, Compare>::Frozen_index() : comp() {}
+
+template<typename K, typename V, typename Compare>
+Frozen_index<K, V, Compare>::Frozen_index(const Compare& c) : comp(c) {}
+
+template<typename K, typename V, typename Compare>
+template<bool Order_statistics, typename Aggregate>
+Frozen_index<K, V, Compare>::Frozen_index(const Red_black_tree<K, V, Compare, Order_statistics, Aggregate>& tree)
+    : comp(tree.key_comp()) {
+    for (const auto& e : tree) {
+        keys.push_back(e.key);
+        vals.push_back(e.val);
+    }
+    build();
+}
+
+template<typename K, typename V, typename Compare>
+template<typename It>
+Frozen_index<K, V, Compare> Frozen_index<K, V, Compare>::from_sorted(It first, It last, const Compare& comp) {
+    Frozen_index index(comp);
+    for (; first != last; ++first) {
+        index.keys.push_back(first->first);
+        index.vals.push_back(first->second);
+    }
+    index.build();
+    return index;
+}
+
+// build method:
+// the last key of a block is its maximum, and padding with the greatest key
+// never changes which block holds a key: copies of the maximum only count as
+// less than keys above everything, and lower_bound clamps those to n.
+template<typename K, typename V, typename Compare>
+void Frozen_index<K, V, Compare>::build() {
+    n = vals.size();
+    levels.clear();
+    if (n == 0) {
+        keys.clear();
+        return;
+    }
+
+    std::size_t start = 0;
+    std::size_t length = n;
+    for (;;) {
+        levels.push_back(start);
+        std::size_t padded = (length + block_keys - 1) / block_keys * block_keys;
+        K greatest = keys[start + length - 1];
+        keys.resize(start + padded, greatest);
+        if (padded == block_keys) {
+            return;
+        }
+        // next level: the maximum of every block of this one
+        std::size_t next = keys.size();
+        keys.reserve(next + padded / block_keys + block_keys);
+        for (std::size_t b = start + block_keys - 1; b < next; b += block_keys) {
+            keys.push_back(keys[b]);
+        }
+        start = next;
+        length = padded / block_keys;
+    }
+}
+
+
+// LOOKUP CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template<typename K, typename V, typename Compare>
+constexpr bool Frozen_index<K, V, Compare>::vectorized() {
+#if defined(__AVX2__) || defined(__SSE4_2__)
+    return std::is_arithmetic<K>::value && !std::is_same<K, bool>::value
+        && (sizeof(K) == 4 || sizeof(K) == 8)
+        && (std::is_same<Compare, std::less<K>>::value || std::is_same<Compare, std::less<>>::value);
+#else
+    return false;
+#endif
+}
+
+// block_rank method:
+// the SIMD paths compute a mask of the lanes below k and count its bits.
+// Unsigned keys are shifted by the sign bit first, SIMD integer compares
+// are signed only.
+template<typename K, typename V, typename Compare>
+std::size_t Frozen_index<K, V, Compare>::block_rank(const K* block, const K& k) const {
+    if constexpr (vectorized()) {
+        unsigned mask = 0;
+#if defined(__AVX2__)
+        if constexpr (std::is_same<K, float>::value) {
+            __m256 x = _mm256_set1_ps(k);
+            for (std::size_t j = 0; j < block_keys; j += 8) {
+                __m256 lt = _mm256_cmp_ps(_mm256_loadu_ps(block + j), x, _CMP_LT_OQ);
+                mask |= static_cast<unsigned>(_mm256_movemask_ps(lt)) << j;
+            }
+        } else if constexpr (std::is_floating_point<K>::value) {
+            __m256d x = _mm256_set1_pd(k);
+            for (std::size_t j = 0; j < block_keys; j += 4) {
+                __m256d lt = _mm256_cmp_pd(_mm256_loadu_pd(block + j), x, _CMP_LT_OQ);
+                mask |= static_cast<unsigned>(_mm256_movemask_pd(lt)) << j;
+            }
+        } else if constexpr (sizeof(K) == 4) {
+            __m256i bias = _mm256_set1_epi32(std::is_signed<K>::value ? 0 : static_cast<int>(0x80000000u));
+            __m256i x = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int>(k)), bias);
+            for (std::size_t j = 0; j < block_keys; j += 8) {
+                __m256i a = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + j)), bias);
+                __m256i lt = _mm256_cmpgt_epi32(x, a);
+                mask |= static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(lt))) << j;
+            }
+        } else {
+            __m256i bias = _mm256_set1_epi64x(std::is_signed<K>::value ? 0 : static_cast<long long>(0x8000000000000000ull));
+            __m256i x = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(k)), bias);
+            for (std::size_t j = 0; j < block_keys; j += 4) {
+                __m256i a = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + j)), bias);
+                __m256i lt = _mm256_cmpgt_epi64(x, a);
+                mask |= static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(lt))) << j;
+            }
+        }
+#elif defined(__SSE4_2__)
+        if constexpr (std::is_same<K, float>::value) {
+            __m128 x = _mm_set1_ps(k);
+            for (std::size_t j = 0; j < block_keys; j += 4) {
+                __m128 lt = _mm_cmplt_ps(_mm_loadu_ps(block + j), x);
+                mask |= static_cast<unsigned>(_mm_movemask_ps(lt)) << j;
+            }
+        } else if constexpr (std::is_floating_point<K>::value) {
+            __m128d x = _mm_set1_pd(k);
+            for (std::size_t j = 0; j < block_keys; j += 2) {
+                __m128d lt = _mm_cmplt_pd(_mm_loadu_pd(block + j), x);
+                mask |= static_cast<unsigned>(_mm_movemask_pd(lt)) << j;
+            }
+        } else if constexpr (sizeof(K) == 4) {
+            __m128i bias = _mm_set1_epi32(std::is_signed<K>::value ? 0 : static_cast<int>(0x80000000u));
+            __m128i x = _mm_xor_si128(_mm_set1_epi32(static_cast<int>(k)), bias);
+            for (std::size_t j = 0; j < block_keys; j += 4) {
+                __m128i a = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + j)), bias);
+                __m128i lt = _mm_cmpgt_epi32(x, a);
+                mask |= static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(lt))) << j;
+            }
+        } else {
+            __m128i bias = _mm_set1_epi64x(std::is_signed<K>::value ? 0 : static_cast<long long>(0x8000000000000000ull));
+            __m128i x = _mm_xor_si128(_mm_set1_epi64x(static_cast<long long>(k)), bias);
+            for (std::size_t j = 0; j < block_keys; j += 2) {
+                __m128i a = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + j)), bias);
+                __m128i lt = _mm_cmpgt_epi64(x, a);
+                mask |= static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(lt))) << j;
+            }
+        }
+#endif
+#if defined(_MSC_VER)
+        return __popcnt(mask);
+#else
+        return static_cast<std::size_t>(__builtin_popcount(mask));
+#endif
+    } else {
+        // no early exit: a data dependent branch per key costs more than the
+        // comparisons it would save in a block this small
+        std::size_t rank = 0;
+        for (std::size_t j = 0; j < block_keys; ++j) {
+            rank += comp(block[j], k) ? 1 : 0;
+        }
+        return rank;
+    }
+}
+
+// lower_bound method:
+// the top level is one block. At every level the rank of k in the current
+// block is the child block holding the first key not less than k; a rank of
+// block_keys can only happen at the top, when k is above every key.
+template<typename K, typename V, typename Compare>
+std::size_t Frozen_index<K, V, Compare>::lower_bound(const K& k) const {
+    if (n == 0) {
+        return 0;
+    }
+    const K* base = keys.data();
+    std::size_t b = 0;
+    for (std::size_t level = levels.size() - 1; level > 0; --level) {
+        std::size_t rank = block_rank(base + levels[level] + b * block_keys, k);
+        if (rank == block_keys) {
+            return n;
+        }
+        b = b * block_keys + rank;
+    }
+    std::size_t i = b * block_keys + block_rank(base + b * block_keys, k);
+    return i < n ? i : n;
+}
+
+template<typename K, typename V, typename Compare>
+std::size_t Frozen_index<K, V, Compare>::size() const {
+    return n;
+}
+
+template<typename K, typename V, typename Compare>
+bool Frozen_index<K, V, Compare>::empty() const {
+    return n == 0;
+}
+
+template<typename K, typename V, typename Compare>
+const V* Frozen_index<K, V, Compare>::find(const K& k) const {
+    std::size_t i = lower_bound(k);
+    return i < n && !comp(k, keys[i]) ? &vals[i] : nullptr;
+}
+
+template<typename K, typename V, typename Compare>
+bool Frozen_index<K, V, Compare>::contains(const K& k) const {
+    return find(k) != nullptr;
+}
+
+template<typename K, typename V, typename Compare>
+const K& Frozen_index<K, V, Compare>::key_at(std::size_t i) const {
+    return keys[i];
+}
+
+template<typename K, typename V, typename Compare>
+const V& Frozen_index<K, V, Compare>::value_at(std::size_t i) const {
+    return vals[i];
+}
+
+template<typename K, typename V, typename Compare>
+template<typename Fn>
+void Frozen_index<K, V, Compare>::for_each_in_range(const K& lo, const K& hi, Fn&& fn) const {
+    for (std::size_t i = lower_bound(lo); i < n && comp(keys[i], hi); ++i) {
+        fn(keys[i], vals[i]);
+    }
+}
+
+template<typename K, typename V, typename Compare>
+template<typename Fn>
+void Frozen_index<K, V, Compare>::for_each(Fn&& fn) const {
+    for (std::size_t i = 0; i < n; ++i) {
+        fn(keys[i], vals[i]);
+    }
+}
+
+template<typename K, typename V, typename Compare>
+Red_black_tree<K, V, Compare> Frozen_index<K, V, Compare>::thaw(unsigned threads) const {
+    static_assert(!Ownership<K>::owned && !Ownership<V>::owned,
+                  "the index borrows its pointers, a tree built from it would release them");
+    return Red_black_tree<K, V, Compare>::from_sorted(begin(), end(), threads);
+}
+
+
+// ITERATOR CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template<typename K, typename V, typename Compare>
+const typename Frozen_index<K, V, Compare>::Entry_ref* Frozen_index<K, V, Compare>::Entry_ref::operator->() const {
+    return this;
+}
+
+template<typename K, typename V, typename Compare>
+typename Frozen_index<K, V, Compare>::const_iterator Frozen_index<K, V, Compare>::begin() const {
+    return const_iterator(this, 0);
+}
+
+template<typename K, typename V, typename Compare>
+typename Frozen_index<K, V, Compare>::const_iterator Frozen_index<K, V, Compare>::end() const {
+    return const_iterator(this, n);
+}
+
+template<typename K, typename V, typename Compare>
+Frozen_index<K, V, Compare>::const_iterator::const_iterator(const Frozen_index* f, std::size_t at) : index(f), i(at) {}
+
+template<typename K, typename V, typename Compare>
+typename Frozen_index<K, V, Compare>::Entry_ref Frozen_index<K, V, Compare>::const_iterator::operator*() const {
+    return Entry_ref{index->keys[i], index->vals[i]};
+}
+
+template<typename K, typename V, typename Compare>
+typename Frozen_index<K, V, Compare>::Entry_ref Frozen_index<K, V, Compare>::const_iterator::operator->() const {
+    return **this;
+}
+
+template<typename K, typename V, typename Compare>
+typename Frozen_index<K, V, Compare>::Entry_ref Frozen_index<K, V, Compare>::const_iterator::operator[](difference_type d) const {
+    return *(*this + d);
+}
+
+template<typename K, typename V, typename Compare>
+typename Frozen_index<K, V, Compare>::const_iterator& Frozen_index<K, V, Compare>::const_iterator::operator++() {
+    ++i;
+    return *this;
+}
+
+template<typename K, typename V, typename Compare>
+typename Frozen_index<K, V, Compare>::const_iterator Frozen_index<K, V, Compare>::const_iterator::operator++(int) {
+    const_iterator before = *this;
+    ++i;
+    return before;
+}
+
+template<typename K, typename V, typename Compare>
+typename Frozen_index<K, V, Compare>::const_iterator& Frozen_index<K, V, Compare>::const_iterator::operator--() {
+    --i;
+    return *this;
+}
+
+template<typename K, typename V, typename Compare>
+typename Frozen_index<K, V, Compare>::const_iterator Frozen_index<K, V, Compare>::const_iterator::operator--(int) {
+    const_iterator before = *this;
+    --i;
+    return before;
+}
+
+template<typename K, typename V, typename Compare>
+typename Frozen_index<K, V, Compare>::const_iterator& Frozen_index<K, V, Compare>::const_iterator::operator+=(difference_type d) {
+    i = static_cast<std::size_t>(static_cast<difference_type>(i) + d);
+    return *this;
+}
+
+template<typename K, typename V, typename Compare>
+typename Frozen_index<K, V, Compare>::const_iterator& Frozen_index<K, V, Compare>::const_iterator::operator-=(difference_type d) {
+    return *this += -d;
+}
+
+template<typename K, typename V, typename Compare>
+typename Frozen_index<K, V, Compare>::const_iterator Frozen_index<K, V, Compare>::const_iterator::operator+(difference_type d) const {
+    const_iterator moved = *this;
+    return moved += d;
+}
+
+template<typename K, typename V, typename Compare>
+typename Frozen_index<K, V, Compare>::const_iterator Frozen_index<K, V, Compare>::const_iterator::operator-(difference_type d) const {
+    const_iterator moved = *this;
+    return moved -= d;
+}
+
+template<typename K, typename V, typename Compare>
+typename Frozen_index<K, V, Compare>::const_iterator::difference_type Frozen_index<K, V, Compare>::const_iterator::operator-(const const_iterator& other) const {
+    return static_cast<difference_type>(i) - static_cast<difference_type>(other.i);
+}
+
+template<typename K, typename V, typename Compare>
+bool Frozen_index<K, V, Compare>::const_iterator::operator==(const const_iterator& other) const {
+    return i == other.i;
+}
+
+template<typename K, typename V, typename Compare>
+bool Frozen_index<K, V, Compare>::const_iterator::operator!=(const const_iterator& other) const {
+    return i != other.i;
+}
+
+template<typename K, typename V, typename Compare>
+bool Frozen_index<K, V, Compare>::const_iterator::operator<(const const_iterator& other) const {
+    return i < other.i;
+}
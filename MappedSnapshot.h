@@ -0,0 +1,102 @@
+#ifndef MAPPED_SNAPSHOT_LIB_H
+#define MAPPED_SNAPSHOT_LIB_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "RBTree.h"
+
+// Mapped_snapshot <K,V,Compare>:
+// K, V, Compare : as for the Red_black_tree that wrote the snapshot
+//
+// Read only view of a file written by Red_black_tree::write_snapshot.
+// The file is memory mapped (POSIX), so opening it costs a few system
+// calls and pages come in as lookups touch them. The records are sorted,
+// lookups binary search them in place.
+//
+// To get a tree back, the records are a sorted range of pairs:
+//     auto tree = Red_black_tree<K, V>::from_sorted(snap.begin(), snap.end());
+// which builds it in O(n), without a single comparison.
+template <typename K, typename V, typename Compare = std::less<K>> struct Mapped_snapshot {
+
+    using Record = Snapshot_record<K, V>;
+
+    // constructor:
+    // ~ maps nothing, open() a file first
+    Mapped_snapshot() = default;
+
+    // constructor overload 1:
+    // ~ opens path, check is_open() afterwards
+    explicit Mapped_snapshot(const std::string& path);
+
+    // destructor:
+    // ~ unmaps the file
+    ~Mapped_snapshot();
+
+    Mapped_snapshot(const Mapped_snapshot&) = delete;
+    Mapped_snapshot& operator=(const Mapped_snapshot&) = delete;
+
+    // move constructor:
+    // ~ takes the mapping of other, leaving it closed
+    Mapped_snapshot(Mapped_snapshot&& other) noexcept;
+
+    // move assignment:
+    Mapped_snapshot& operator=(Mapped_snapshot&& other) noexcept;
+
+    // open:
+    // ~ maps path and checks its header (signature, version, byte order,
+    // key and value sizes, record alignment and file length). Returns false
+    // and stays closed if anything does not match.
+    bool open(const std::string& path);
+
+    // close:
+    // ~ unmaps the file, pointers handed out before are gone with it
+    void close();
+
+    // is_open:
+    bool is_open() const;
+
+    // size:
+    // ~ number of records
+    std::size_t size() const;
+
+    // empty:
+    bool empty() const;
+
+    // begin, end:
+    // ~ the records, in key order
+    const Record* begin() const;
+    const Record* end() const;
+
+    // find:
+    // ~ the value at k, nullptr if k is not in the snapshot. O(log n)
+    const V* find(const K& k) const;
+
+    // contains:
+    bool contains(const K& k) const;
+
+    // lower_bound:
+    // ~ first record with key >= k, end() if there is none
+    const Record* lower_bound(const K& k) const;
+
+    // for_each_in_range:
+    // ~ calls fn(key, val) for lo <= key < hi, in order
+    template <typename Fn>
+    void for_each_in_range(const K& lo, const K& hi, Fn&& fn) const;
+
+    private:
+        void* mapping = nullptr;
+        std::size_t mapped_bytes = 0;
+        const Record* records = nullptr;
+        std::size_t count = 0;
+        Compare comp;
+
+        // valid:
+        // whether a header describes a snapshot of K,V that fits in bytes
+        static bool valid(const Snapshot_header& header, std::size_t bytes);
+};
+
+#include "MappedSnapshot.impl.h"
+#endif //MAPPED_SNAPSHOT_LIB_H
@@ -0,0 +1,167 @@
+#include "MappedSnapshot.h"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// MAPPING CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template<typename K, typename V, typename Compare>
+Mapped_snapshot<K, V, Compare>::Mapped_snapshot(const std::string& path) {
+    open(path);
+}
+
+template<typename K, typename V, typename Compare>
+Mapped_snapshot<K, V, Compare>::~Mapped_snapshot() {
+    close();
+}
+
+template<typename K, typename V, typename Compare>
+Mapped_snapshot<K, V, Compare>::Mapped_snapshot(Mapped_snapshot&& other) noexcept
+    : mapping(other.mapping), mapped_bytes(other.mapped_bytes),
+      records(other.records), count(other.count), comp(other.comp) {
+    other.mapping = nullptr;
+    other.mapped_bytes = 0;
+    other.records = nullptr;
+    other.count = 0;
+}
+
+template<typename K, typename V, typename Compare>
+Mapped_snapshot<K, V, Compare>& Mapped_snapshot<K, V, Compare>::operator=(Mapped_snapshot&& other) noexcept {
+    if (this != &other) {
+        close();
+        mapping = other.mapping;
+        mapped_bytes = other.mapped_bytes;
+        records = other.records;
+        count = other.count;
+        comp = other.comp;
+        other.mapping = nullptr;
+        other.mapped_bytes = 0;
+        other.records = nullptr;
+        other.count = 0;
+    }
+    return *this;
+}
+
+template<typename K, typename V, typename Compare>
+bool Mapped_snapshot<K, V, Compare>::valid(const Snapshot_header& header, std::size_t bytes) {
+    if (std::memcmp(header.magic, Snapshot_header::signature, sizeof header.magic) != 0) return false;
+    if (header.version != Snapshot_header::current_version) return false;
+    if (header.byte_order != Snapshot_header::native_byte_order) return false;
+    if (header.key_size != sizeof(K) || header.value_size != sizeof(V)) return false;
+    if (header.record_size != sizeof(Record)) return false;
+    if (header.records_offset < sizeof(Snapshot_header) || header.records_offset % alignof(Record) != 0) return false;
+    if (header.records_offset > bytes) return false;
+    // count * record_size must fit in what is left, without overflowing
+    return header.count <= (bytes - header.records_offset) / sizeof(Record);
+}
+
+template<typename K, typename V, typename Compare>
+bool Mapped_snapshot<K, V, Compare>::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(Snapshot_header)) {
+        ::close(fd);
+        return false;
+    }
+    std::size_t bytes = static_cast<std::size_t>(st.st_size);
+    void* m = ::mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file alive on its own
+    ::close(fd);
+    if (m == MAP_FAILED) return false;
+
+    Snapshot_header header;
+    std::memcpy(&header, m, sizeof header);
+    if (!valid(header, bytes)) {
+        ::munmap(m, bytes);
+        return false;
+    }
+
+    mapping = m;
+    mapped_bytes = bytes;
+    records = reinterpret_cast<const Record*>(static_cast<const char*>(m) + header.records_offset);
+    count = static_cast<std::size_t>(header.count);
+    return true;
+}
+
+template<typename K, typename V, typename Compare>
+void Mapped_snapshot<K, V, Compare>::close() {
+    if (mapping) {
+        ::munmap(mapping, mapped_bytes);
+    }
+    mapping = nullptr;
+    mapped_bytes = 0;
+    records = nullptr;
+    count = 0;
+}
+
+
+// LOOKUP CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template<typename K, typename V, typename Compare>
+bool Mapped_snapshot<K, V, Compare>::is_open() const {
+    return mapping != nullptr;
+}
+
+template<typename K, typename V, typename Compare>
+std::size_t Mapped_snapshot<K, V, Compare>::size() const {
+    return count;
+}
+
+template<typename K, typename V, typename Compare>
+bool Mapped_snapshot<K, V, Compare>::empty() const {
+    return count == 0;
+}
+
+template<typename K, typename V, typename Compare>
+const typename Mapped_snapshot<K, V, Compare>::Record* Mapped_snapshot<K, V, Compare>::begin() const {
+    return records;
+}
+
+template<typename K, typename V, typename Compare>
+const typename Mapped_snapshot<K, V, Compare>::Record* Mapped_snapshot<K, V, Compare>::end() const {
+    return records + count;
+}
+
+template<typename K, typename V, typename Compare>
+const typename Mapped_snapshot<K, V, Compare>::Record* Mapped_snapshot<K, V, Compare>::lower_bound(const K& k) const {
+    const Record* first = records;
+    std::size_t n = count;
+    while (n > 0) {
+        std::size_t half = n / 2;
+        if (comp(first[half].first, k)) {
+            first += half + 1;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+    return first;
+}
+
+template<typename K, typename V, typename Compare>
+const V* Mapped_snapshot<K, V, Compare>::find(const K& k) const {
+    const Record* r = lower_bound(k);
+    return r != end() && !comp(k, r->first) ? &r->second : nullptr;
+}
+
+template<typename K, typename V, typename Compare>
+bool Mapped_snapshot<K, V, Compare>::contains(const K& k) const {
+    return find(k) != nullptr;
+}
+
+template<typename K, typename V, typename Compare>
+template <typename Fn>
+void Mapped_snapshot<K, V, Compare>::for_each_in_range(const K& lo, const K& hi, Fn&& fn) const {
+    for (const Record* r = lower_bound(lo); r != end() && comp(r->first, hi); ++r) {
+        fn(r->first, r->second);
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef PATH_COPY_LIB_H
+#define PATH_COPY_LIB_H
+
+#include <cstddef>
+
+// Path_copy <K,V,Compare,Node,Write>:
+// K, V, Compare : as for Red_black_tree
+// Node (node type) : has key, val, left, right and a bool color (true = red)
+// Write (write context) : decides what building a node means, see below
+//
+// Functional red black tree after Kahrs, "Red-black trees with types" (2001).
+// insert and remove are pure functions over subtrees: they never modify a
+// node, they ask the Write to build one. That is exactly path copying, so
+// trees that keep old versions alive (Concurrent_red_black_tree,
+// Persistent_red_black_tree) share this code and only differ in their Write:
+//
+//   Node* make(bool c, Node* l, Node* y, Node* r)  the entry of y, color c, children l, r
+//   Node* make_valued(Node* l, Node* y, Node* r, const V& v)  same, color of y, value v
+//   Node* make_leaf(const K& k, const V& v)  a new red node without children
+//   void unlink(Node* N)  N was removed from the tree
+//
+// make may reuse y when the write itself built it, so callers always read
+// the children they need before calling it.
+template <typename K, typename V, typename Compare, typename Node, typename Write> struct Path_copy {
+
+    static constexpr bool red   = true;
+    static constexpr bool black = false;
+
+    static bool is_red(const Node* N);
+    static bool is_black(const Node* N);
+
+    // find:
+    // ~ the node at k under N, nullptr if there is none
+    static const Node* find(const Node* N, const K& k, const Compare& comp);
+
+    // insert:
+    // ~ the tree N with k,v added (value replaced if k is there)
+    static Node* insert(Write& w, Node* N, const K& k, const V& v, const Compare& comp);
+
+    // remove:
+    // ~ the tree N without k. k must be in N.
+    static Node* remove(Write& w, Node* N, const K& k, const Compare& comp);
+
+    // blacken:
+    // ~ the root after insert or remove, painted black
+    static Node* blacken(Write& w, Node* N);
+
+    // for_each_in_range:
+    // ~ calls fn(key, val) for lo <= key < hi under N, in order
+    template <typename Fn>
+    static void for_each_in_range(const Node* N, const K& lo, const K& hi, Fn&& fn, const Compare& comp);
+
+    // for_each:
+    // ~ calls fn(key, val) for every entry under N, in order
+    template <typename Fn>
+    static void for_each(const Node* N, Fn&& fn);
+
+    private:
+
+        // Height is at most 2 log2(n + 1), 128 covers any n that fits in memory
+        static constexpr std::size_t max_height = 128;
+
+        // balance:
+        // the five red-red shapes all become a red node with two black children
+        static Node* balance(Write& w, Node* l, Node* y, Node* r);
+
+        // balance_left, balance_right:
+        // l (resp. r) lost one black level
+        static Node* balance_left(Write& w, Node* l, Node* y, Node* r);
+        static Node* balance_right(Write& w, Node* l, Node* y, Node* r);
+
+        // redden:
+        // N painted red
+        static Node* redden(Write& w, Node* N);
+
+        // append:
+        // joins the two children of a removed node, l holds the smaller keys
+        static Node* append(Write& w, Node* l, Node* r);
+};
+
+#include "PathCopy.impl.h"
+#endif //PATH_COPY_LIB_H
@@ -0,0 +1,231 @@
+#include "PathCopy.h"
+
+// Path copying red black tree code.
+// Children are always read into locals before w.make() is called:
+// make() may reuse the very node they came from.
+
+
+// LOOKUP AND TRAVERSAL CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template<typename K, typename V, typename Compare, typename Node, typename Write>
+bool Path_copy<K, V, Compare, Node, Write>::is_red(const Node* N) {
+    return N && N->color == red;
+}
+
+template<typename K, typename V, typename Compare, typename Node, typename Write>
+bool Path_copy<K, V, Compare, Node, Write>::is_black(const Node* N) {
+    return N && N->color == black;
+}
+
+template<typename K, typename V, typename Compare, typename Node, typename Write>
+const Node* Path_copy<K, V, Compare, Node, Write>::find(const Node* N, const K& k, const Compare& comp) {
+    // one comparison per level, equality checked once on the last candidate
+    const Node* candidate = nullptr;
+    while (N) {
+        if (comp(N->key, k)) {
+            N = N->right;
+        } else {
+            candidate = N;
+            N = N->left;
+        }
+    }
+    return candidate && !comp(k, candidate->key) ? candidate : nullptr;
+}
+
+template<typename K, typename V, typename Compare, typename Node, typename Write>
+template <typename Fn>
+void Path_copy<K, V, Compare, Node, Write>::for_each_in_range(const Node* N, const K& lo, const K& hi, Fn&& fn, const Compare& comp) {
+    // shared nodes have no parent links, so walk with an explicit stack
+    const Node* stack[max_height];
+    std::size_t depth = 0;
+
+    while (N || depth) {
+        // go left only while keys can still be >= lo
+        while (N) {
+            if (comp(N->key, lo)) {
+                N = N->right;
+            } else {
+                stack[depth++] = N;
+                N = N->left;
+            }
+        }
+        if (!depth) return;
+        N = stack[--depth];
+        if (!comp(N->key, hi)) return;
+        fn(N->key, N->val);
+        N = N->right;
+    }
+}
+
+template<typename K, typename V, typename Compare, typename Node, typename Write>
+template <typename Fn>
+void Path_copy<K, V, Compare, Node, Write>::for_each(const Node* N, Fn&& fn) {
+    const Node* stack[max_height];
+    std::size_t depth = 0;
+
+    while (N || depth) {
+        while (N) {
+            stack[depth++] = N;
+            N = N->left;
+        }
+        N = stack[--depth];
+        fn(N->key, N->val);
+        N = N->right;
+    }
+}
+
+
+// FUNCTIONAL RED BLACK TREE CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template<typename K, typename V, typename Compare, typename Node, typename Write>
+Node* Path_copy<K, V, Compare, Node, Write>::balance(Write& w, Node* l, Node* y, Node* r) {
+    if (is_red(l) && is_red(r)) {
+        Node* a = l->left; Node* b = l->right;
+        Node* c = r->left; Node* d = r->right;
+        Node* left = w.make(black, a, l, b);
+        Node* right = w.make(black, c, r, d);
+        return w.make(red, left, y, right);
+    }
+    if (is_red(l) && is_red(l->left)) {
+        Node* ll = l->left;
+        Node* a = ll->left; Node* b = ll->right; Node* c = l->right;
+        Node* left = w.make(black, a, ll, b);
+        Node* right = w.make(black, c, y, r);
+        return w.make(red, left, l, right);
+    }
+    if (is_red(l) && is_red(l->right)) {
+        Node* lr = l->right;
+        Node* a = l->left; Node* b = lr->left; Node* c = lr->right;
+        Node* left = w.make(black, a, l, b);
+        Node* right = w.make(black, c, y, r);
+        return w.make(red, left, lr, right);
+    }
+    if (is_red(r) && is_red(r->right)) {
+        Node* rr = r->right;
+        Node* b = r->left; Node* c = rr->left; Node* d = rr->right;
+        Node* left = w.make(black, l, y, b);
+        Node* right = w.make(black, c, rr, d);
+        return w.make(red, left, r, right);
+    }
+    if (is_red(r) && is_red(r->left)) {
+        Node* rl = r->left;
+        Node* b = rl->left; Node* c = rl->right; Node* d = r->right;
+        Node* left = w.make(black, l, y, b);
+        Node* right = w.make(black, c, r, d);
+        return w.make(red, left, rl, right);
+    }
+    return w.make(black, l, y, r);
+}
+
+template<typename K, typename V, typename Compare, typename Node, typename Write>
+Node* Path_copy<K, V, Compare, Node, Write>::balance_left(Write& w, Node* l, Node* y, Node* r) {
+    if (is_red(l)) {
+        Node* a = l->left; Node* b = l->right;
+        return w.make(red, w.make(black, a, l, b), y, r);
+    }
+    if (is_black(r)) {
+        Node* a = r->left; Node* b = r->right;
+        return balance(w, l, y, w.make(red, a, r, b));
+    }
+    // r is red and its left child black
+    Node* rl = r->left; Node* rr = r->right;
+    Node* a = rl->left; Node* b = rl->right;
+    Node* right = balance(w, b, r, redden(w, rr));
+    Node* left = w.make(black, l, y, a);
+    return w.make(red, left, rl, right);
+}
+
+template<typename K, typename V, typename Compare, typename Node, typename Write>
+Node* Path_copy<K, V, Compare, Node, Write>::balance_right(Write& w, Node* l, Node* y, Node* r) {
+    if (is_red(r)) {
+        Node* a = r->left; Node* b = r->right;
+        return w.make(red, l, y, w.make(black, a, r, b));
+    }
+    if (is_black(l)) {
+        Node* a = l->left; Node* b = l->right;
+        return balance(w, w.make(red, a, l, b), y, r);
+    }
+    // l is red and its right child black
+    Node* ll = l->left; Node* lr = l->right;
+    Node* b = lr->left; Node* c = lr->right;
+    Node* left = balance(w, redden(w, ll), l, b);
+    Node* right = w.make(black, c, y, r);
+    return w.make(red, left, lr, right);
+}
+
+template<typename K, typename V, typename Compare, typename Node, typename Write>
+Node* Path_copy<K, V, Compare, Node, Write>::redden(Write& w, Node* N) {
+    Node* a = N->left; Node* b = N->right;
+    return w.make(red, a, N, b);
+}
+
+template<typename K, typename V, typename Compare, typename Node, typename Write>
+Node* Path_copy<K, V, Compare, Node, Write>::append(Write& w, Node* l, Node* r) {
+    if (!l) return r;
+    if (!r) return l;
+
+    if (is_red(l) == is_red(r)) {
+        bool c = l->color;
+        Node* a = l->left; Node* b = l->right;
+        Node* x = r->left; Node* d = r->right;
+        Node* middle = append(w, b, x);
+
+        if (is_red(middle)) {
+            Node* ml = middle->left; Node* mr = middle->right;
+            Node* left = w.make(c, a, l, ml);
+            Node* right = w.make(c, mr, r, d);
+            return w.make(red, left, middle, right);
+        }
+        if (c == red) {
+            return w.make(red, a, l, w.make(red, middle, r, d));
+        }
+        return balance_left(w, a, l, w.make(black, middle, r, d));
+    }
+    if (is_red(r)) {
+        Node* a = r->left; Node* b = r->right;
+        return w.make(red, append(w, l, a), r, b);
+    }
+    Node* a = l->left; Node* b = l->right;
+    return w.make(red, a, l, append(w, b, r));
+}
+
+template<typename K, typename V, typename Compare, typename Node, typename Write>
+Node* Path_copy<K, V, Compare, Node, Write>::insert(Write& w, Node* N, const K& k, const V& v, const Compare& comp) {
+    if (!N) return w.make_leaf(k, v);
+
+    Node* l = N->left; Node* r = N->right;
+    if (comp(k, N->key)) {
+        l = insert(w, l, k, v, comp);
+        return N->color == black ? balance(w, l, N, r) : w.make(red, l, N, r);
+    }
+    if (comp(N->key, k)) {
+        r = insert(w, r, k, v, comp);
+        return N->color == black ? balance(w, l, N, r) : w.make(red, l, N, r);
+    }
+    return w.make_valued(l, N, r, v);
+}
+
+template<typename K, typename V, typename Compare, typename Node, typename Write>
+Node* Path_copy<K, V, Compare, Node, Write>::remove(Write& w, Node* N, const K& k, const Compare& comp) {
+    // only called once k is known to be in the tree, so N is never null
+    Node* l = N->left; Node* r = N->right;
+    if (comp(k, N->key)) {
+        bool shrinks = is_black(l);
+        l = remove(w, l, k, comp);
+        return shrinks ? balance_left(w, l, N, r) : w.make(red, l, N, r);
+    }
+    if (comp(N->key, k)) {
+        bool shrinks = is_black(r);
+        r = remove(w, r, k, comp);
+        return shrinks ? balance_right(w, l, N, r) : w.make(red, l, N, r);
+    }
+    w.unlink(N);
+    return append(w, l, r);
+}
+
+template<typename K, typename V, typename Compare, typename Node, typename Write>
+Node* Path_copy<K, V, Compare, Node, Write>::blacken(Write& w, Node* N) {
+    if (!is_red(N)) return N;
+    Node* l = N->left; Node* r = N->right;
+    return w.make(black, l, N, r);
+}
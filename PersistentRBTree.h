@@ -0,0 +1,144 @@
+#ifndef PERSISTENT_RBTREE_LIB_H
+#define PERSISTENT_RBTREE_LIB_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory_resource>
+#include <vector>
+
+#include "PathCopy.h"
+
+// Persistent_red_black_tree <K,V,Compare>:
+// K, V, Compare : as for Red_black_tree
+//
+// Versioned red black tree. Every object is one version: copying it is
+// O(1) and shares every node, and insert/remove only copy the O(log n)
+// nodes they change, so each new version costs O(log n) memory and all
+// untouched subtrees stay shared with older versions.
+//
+// Nodes are reference counted (atomically), a node is freed when the
+// last version reaching it goes away. Different versions may be used and
+// destroyed from different threads, one version from one thread at a time.
+// Nodes come from the memory resource of the version they were built in,
+// which must be thread safe if versions cross threads (the default is).
+template <typename K, typename V, typename Compare = std::less<K>> struct Persistent_red_black_tree {
+
+    // constructor:
+    // ~ initializes an empty tree
+    Persistent_red_black_tree();
+
+    // constructor overload 1:
+    // ~ nodes are allocated from the given memory resource
+    explicit Persistent_red_black_tree(std::pmr::memory_resource* resource);
+
+    // copy constructor:
+    // ~ O(1), the copy shares every node (and the memory resource)
+    Persistent_red_black_tree(const Persistent_red_black_tree& other);
+
+    // move constructor:
+    // ~ takes the version of other, leaving it empty
+    Persistent_red_black_tree(Persistent_red_black_tree&& other) noexcept;
+
+    // copy assignment:
+    // ~ O(1) plus freeing whatever only this version held
+    Persistent_red_black_tree& operator=(const Persistent_red_black_tree& other);
+
+    // move assignment:
+    Persistent_red_black_tree& operator=(Persistent_red_black_tree&& other) noexcept;
+
+    // destructor:
+    // ~ frees the nodes no other version shares, stops at shared subtrees
+    ~Persistent_red_black_tree();
+
+    // snapshot:
+    // ~ O(1) point-in-time copy, later writes to this tree do not show in it
+    Persistent_red_black_tree snapshot() const;
+
+    // insert:
+    // ~ adds k,v (replaces the value if k is there). Copies O(log n) nodes.
+    void insert(const K& k, const V& v);
+
+    // remove:
+    // ~ removes k, returns whether it was there
+    bool remove(const K& k);
+
+    // clear:
+    // ~ drops this version's nodes, the tree becomes empty
+    void clear();
+
+    // find:
+    // ~ the value at k, nullptr if k is not there. Valid while this
+    // version is not modified or destroyed.
+    const V* find(const K& k) const;
+
+    // contains:
+    // ~ whether k is in this version
+    bool contains(const K& k) const;
+
+    // size, empty:
+    std::size_t size() const;
+    bool empty() const;
+
+    // for_each_in_range:
+    // ~ calls fn(key, val) for lo <= key < hi, in order
+    template <typename Fn>
+    void for_each_in_range(const K& lo, const K& hi, Fn&& fn) const;
+
+    // for_each:
+    // ~ calls fn(key, val) for every entry, in order
+    template <typename Fn>
+    void for_each(Fn&& fn) const;
+
+    private:
+
+        // Node struct:
+        // refs counts the parents and versions pointing at it. A node with
+        // no reference yet was built by the write in progress, only that
+        // write can see it and it is modified in place.
+        struct Node {
+            K key;
+            V val;
+            Node* left;
+            Node* right;
+            bool color;
+            std::atomic<std::size_t> refs;
+        };
+
+        // Write struct:
+        // builds nodes for Path_copy and remembers them, so their children
+        // get counted once the write is done
+        struct Write {
+            std::pmr::memory_resource* resource;
+            std::vector<Node*> built;
+            bool grew;
+
+            Node* make(bool c, Node* l, Node* y, Node* r);
+            Node* make_valued(Node* l, Node* y, Node* r, const V& v);
+            Node* make_leaf(const K& k, const V& v);
+            void unlink(Node* N);
+
+            Node* build(const K& k, const V& v, Node* l, Node* r, bool c);
+        };
+
+        using Ops = Path_copy<K, V, Compare, Node, Write>;
+
+        Node* root;
+        std::size_t count;
+        std::pmr::memory_resource* resource;
+        Compare comp;
+
+        // commit:
+        // counts the references of what the write built and makes R the
+        // root of this version, releasing the previous one
+        void commit(Node* R, Write& w);
+
+        // acquire, release:
+        // one reference more or less. release frees N when it was the last
+        // one, and the children it held in turn.
+        static void acquire(Node* N);
+        static void release(Node* N, std::pmr::memory_resource* resource);
+};
+
+#include "PersistentRBTree.impl.h"
+#endif //PERSISTENT_RBTREE_LIB_H
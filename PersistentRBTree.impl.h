@@ -0,0 +1,206 @@
+#include "PersistentRBTree.h"
+
+#include <new>
+#include <utility>
+
+// Persistent variant of the RBTree library.
+// Rebalancing lives in PathCopy.h, this file only counts references.
+
+
+// REFERENCE COUNTING CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template<typename K, typename V, typename Compare>
+void Persistent_red_black_tree<K, V, Compare>::acquire(Node* N) {
+    if (N) N->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+template<typename K, typename V, typename Compare>
+void Persistent_red_black_tree<K, V, Compare>::release(Node* N, std::pmr::memory_resource* resource) {
+    // recursion only goes on through nodes being freed,
+    // so it is bounded by the height and stops at shared subtrees
+    if (!N || N->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+    Node* l = N->left;
+    Node* r = N->right;
+    N->~Node();
+    resource->deallocate(N, sizeof(Node), alignof(Node));
+    release(l, resource);
+    release(r, resource);
+}
+
+template<typename K, typename V, typename Compare>
+void Persistent_red_black_tree<K, V, Compare>::commit(Node* R, Write& w) {
+    // counting only now keeps Path_copy from having to fix counts each time
+    // it reuses a node. Count before releasing: shared nodes must survive.
+    for (Node* N : w.built) {
+        acquire(N->left);
+        acquire(N->right);
+    }
+    acquire(R);
+    release(root, resource);
+    root = R;
+}
+
+
+// PERSISTENT RED BLACK TREE CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template<typename K, typename V, typename Compare>
+Persistent_red_black_tree<K, V, Compare>::Persistent_red_black_tree()
+    : Persistent_red_black_tree(std::pmr::get_default_resource()) {}
+
+template<typename K, typename V, typename Compare>
+Persistent_red_black_tree<K, V, Compare>::Persistent_red_black_tree(std::pmr::memory_resource* resource)
+    : root(nullptr), count(0), resource(resource), comp() {}
+
+template<typename K, typename V, typename Compare>
+Persistent_red_black_tree<K, V, Compare>::Persistent_red_black_tree(const Persistent_red_black_tree& other)
+    : root(other.root), count(other.count), resource(other.resource), comp(other.comp) {
+    acquire(root);
+}
+
+template<typename K, typename V, typename Compare>
+Persistent_red_black_tree<K, V, Compare>::Persistent_red_black_tree(Persistent_red_black_tree&& other) noexcept
+    : root(std::exchange(other.root, nullptr)), count(std::exchange(other.count, 0)),
+      resource(other.resource), comp(other.comp) {}
+
+template<typename K, typename V, typename Compare>
+Persistent_red_black_tree<K, V, Compare>& Persistent_red_black_tree<K, V, Compare>::operator=(const Persistent_red_black_tree& other) {
+    acquire(other.root);
+    release(root, resource);
+    root = other.root;
+    count = other.count;
+    resource = other.resource;
+    comp = other.comp;
+    return *this;
+}
+
+template<typename K, typename V, typename Compare>
+Persistent_red_black_tree<K, V, Compare>& Persistent_red_black_tree<K, V, Compare>::operator=(Persistent_red_black_tree&& other) noexcept {
+    if (this != &other) {
+        release(root, resource);
+        root = std::exchange(other.root, nullptr);
+        count = std::exchange(other.count, 0);
+        resource = other.resource;
+        comp = other.comp;
+    }
+    return *this;
+}
+
+template<typename K, typename V, typename Compare>
+Persistent_red_black_tree<K, V, Compare>::~Persistent_red_black_tree() {
+    release(root, resource);
+}
+
+template<typename K, typename V, typename Compare>
+Persistent_red_black_tree<K, V, Compare> Persistent_red_black_tree<K, V, Compare>::snapshot() const {
+    return *this;
+}
+
+template<typename K, typename V, typename Compare>
+void Persistent_red_black_tree<K, V, Compare>::insert(const K& k, const V& v) {
+    Write w{resource, {}, false};
+    Node* R = Ops::insert(w, root, k, v, comp);
+    commit(Ops::blacken(w, R), w);
+    count += w.grew;
+}
+
+template<typename K, typename V, typename Compare>
+bool Persistent_red_black_tree<K, V, Compare>::remove(const K& k) {
+    // a miss would still copy the whole path, so look first
+    if (!Ops::find(root, k, comp)) return false;
+
+    Write w{resource, {}, false};
+    Node* R = Ops::remove(w, root, k, comp);
+    commit(Ops::blacken(w, R), w);
+    --count;
+    return true;
+}
+
+template<typename K, typename V, typename Compare>
+void Persistent_red_black_tree<K, V, Compare>::clear() {
+    release(root, resource);
+    root = nullptr;
+    count = 0;
+}
+
+template<typename K, typename V, typename Compare>
+const V* Persistent_red_black_tree<K, V, Compare>::find(const K& k) const {
+    const Node* N = Ops::find(root, k, comp);
+    return N ? &N->val : nullptr;
+}
+
+template<typename K, typename V, typename Compare>
+bool Persistent_red_black_tree<K, V, Compare>::contains(const K& k) const {
+    return Ops::find(root, k, comp) != nullptr;
+}
+
+template<typename K, typename V, typename Compare>
+std::size_t Persistent_red_black_tree<K, V, Compare>::size() const {
+    return count;
+}
+
+template<typename K, typename V, typename Compare>
+bool Persistent_red_black_tree<K, V, Compare>::empty() const {
+    return count == 0;
+}
+
+template<typename K, typename V, typename Compare>
+template <typename Fn>
+void Persistent_red_black_tree<K, V, Compare>::for_each_in_range(const K& lo, const K& hi, Fn&& fn) const {
+    Ops::for_each_in_range(root, lo, hi, fn, comp);
+}
+
+template<typename K, typename V, typename Compare>
+template <typename Fn>
+void Persistent_red_black_tree<K, V, Compare>::for_each(Fn&& fn) const {
+    Ops::for_each(root, fn);
+}
+
+
+// Path copying hooks ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template<typename K, typename V, typename Compare>
+typename Persistent_red_black_tree<K, V, Compare>::Node*
+Persistent_red_black_tree<K, V, Compare>::Write::build(const K& k, const V& v, Node* l, Node* r, bool c) {
+    void* storage = resource->allocate(sizeof(Node), alignof(Node));
+    Node* N = new (storage) Node{k, v, l, r, c, 0};
+    built.push_back(N);
+    return N;
+}
+
+template<typename K, typename V, typename Compare>
+typename Persistent_red_black_tree<K, V, Compare>::Node*
+Persistent_red_black_tree<K, V, Compare>::Write::make(bool c, Node* l, Node* y, Node* r) {
+    if (y->refs.load(std::memory_order_relaxed) == 0) {
+        // built by this write, nobody else can see it yet
+        y->color = c;
+        y->left = l;
+        y->right = r;
+        return y;
+    }
+    return build(y->key, y->val, l, r, c);
+}
+
+template<typename K, typename V, typename Compare>
+typename Persistent_red_black_tree<K, V, Compare>::Node*
+Persistent_red_black_tree<K, V, Compare>::Write::make_valued(Node* l, Node* y, Node* r, const V& v) {
+    if (y->refs.load(std::memory_order_relaxed) == 0) {
+        y->val = v;
+        y->left = l;
+        y->right = r;
+        return y;
+    }
+    return build(y->key, v, l, r, y->color);
+}
+
+template<typename K, typename V, typename Compare>
+typename Persistent_red_black_tree<K, V, Compare>::Node*
+Persistent_red_black_tree<K, V, Compare>::Write::make_leaf(const K& k, const V& v) {
+    grew = true;
+    return build(k, v, nullptr, nullptr, Ops::red);
+}
+
+template<typename K, typename V, typename Compare>
+void Persistent_red_black_tree<K, V, Compare>::Write::unlink(Node*) {
+    // the old version still holds it, release() frees it with that version
+}
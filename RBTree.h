@@ -1,82 +1,850 @@
 #ifndef RBTREE_LIB_H
 #define RBTREE_LIB_H
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <ostream>
+#include <sstream>
 #include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 // RBTree library by Jaime Meyer Beilis Michel.
 // Last edit: 18 May 2025
 // in a very sweaty summer.
 
-// Red_black_tree <K,V>:
-// K (data type) : With an ordering and equivalence (<, >, ==) defined,
+// RBTREE_NO_UNIQUE_ADDRESS:
+// lets an empty member take no room (C++20 [[no_unique_address]], which
+// GCC and Clang also honour in C++17 mode, MSVC under its own name)
+#if defined(_MSC_VER) && !defined(__clang__)
+#define RBTREE_NO_UNIQUE_ADDRESS [[msvc::no_unique_address]]
+#elif defined(__has_cpp_attribute)
+#if __has_cpp_attribute(no_unique_address)
+#define RBTREE_NO_UNIQUE_ADDRESS [[no_unique_address]]
+#endif
+#endif
+#ifndef RBTREE_NO_UNIQUE_ADDRESS
+#define RBTREE_NO_UNIQUE_ADDRESS
+#endif
+
+// Tree_event:
+// what Tree_stats counts. insertion_case_i is case i of balance_insertion
+// (7 to 10 mirror 3 to 6 with N on the same side), removal_case_i case i
+// of balance_removal (either side).
+enum Tree_event : std::size_t {
+    key_comparisons,
+    left_rotations,
+    right_rotations,
+    recolors,
+    node_allocations,
+    insertion_case_1, insertion_case_2, insertion_case_3, insertion_case_4, insertion_case_5,
+    insertion_case_6, insertion_case_7, insertion_case_8, insertion_case_9, insertion_case_10,
+    removal_case_1, removal_case_2, removal_case_3, removal_case_4,
+    tree_event_count
+};
+
+// Tree_stats:
+// process wide counters of what the trees do, for metrics export.
+// Opt in by defining RBTREE_STATS (the same way in every translation unit)
+// before including RBTree.h; otherwise count() compiles to nothing and the
+// counters stay at zero. Counting is one relaxed atomic add shared by every
+// tree and thread, cheap enough for a canary host, not free.
+struct Tree_stats {
+#ifdef RBTREE_STATS
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    using Counters = std::array<std::uint64_t, tree_event_count>;
+
+    // count:
+    // ~ adds n to the counter of e
+    static void count(Tree_event e, std::uint64_t n = 1);
+
+    // read:
+    // ~ every counter, indexed by Tree_event
+    static Counters read();
+
+    // reset:
+    // ~ every counter back to zero
+    static void reset();
+
+    // name:
+    // ~ stable snake_case name of e, usable as a metric name
+    static const char* name(Tree_event e);
+
+    // write_to:
+    // ~ one "rbtree_<name> <value>" line per counter
+    static void write_to(std::ostream& out);
+
+    private:
+        static inline std::atomic<std::uint64_t> counters[tree_event_count] = {};
+};
+
+// Counted_compare <Compare>:
+// Compare reporting every call as a key comparison. Trees order their keys
+// with it when Tree_stats is enabled, with Compare itself otherwise.
+template <typename Compare> struct Counted_compare {
+    Counted_compare() = default;
+    Counted_compare(const Compare& c);
+
+    template <typename A, typename B>
+    bool operator()(const A& a, const B& b) const;
+
+    Compare order{};
+};
+
+// Node_arena <T>:
+// T (data type) : the node type handed out by the arena
+//
+// Slab allocator for tree nodes. Storage is carved out of blocks
+// requested from an upstream std::pmr::memory_resource, nodes given
+// back through recycle() are kept in a free list for the next allocation,
+// and release() returns every block at once instead of one delete per node.
+//
+// Every tree has an arena of its own. Trees that exchanged nodes (join,
+// split, the set algebra) merge their arenas into one group: the blocks
+// then live until the last arena of the group is gone, while each arena
+// keeps its own free list and current block, so the trees can still be
+// modified concurrently. Only new blocks and group changes take a lock.
+template <typename T> struct Node_arena {
+
+    // constructor:
+    // ~ takes blocks from the given resource (default resource otherwise)
+    explicit Node_arena(std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+
+    // destructor:
+    // ~ leaves the group, returning all its blocks to the upstream
+    // resource if it was the last arena in it
+    ~Node_arena();
+
+    // blocks are owned, so the arena is not copyable
+    Node_arena(const Node_arena&) = delete;
+    Node_arena& operator=(const Node_arena&) = delete;
+
+    // allocate:
+    // ~ raw storage for one T. The free list is used first, then the
+    // current block, then a new block twice as large as the last one.
+    void* allocate();
+
+    // recycle:
+    // ~ puts the storage of an already destroyed T back in the free list
+    void recycle(void* p);
+
+    // allocate_array:
+    // ~ raw storage for n consecutive T in one dedicated block
+    T* allocate_array(std::size_t n);
+
+    // release:
+    // ~ returns every block to the upstream resource. It costs one call per
+    // block (blocks grow geometrically, so O(log n)), not one per node.
+    // Objects still living in the arena are NOT destroyed. An arena whose
+    // group other arenas still use leaves it for a new, empty one instead.
+    void release();
+
+    // resource:
+    // ~ the upstream resource new blocks are taken from
+    std::pmr::memory_resource* resource() const;
+
+    // shares_blocks:
+    // ~ whether other arenas are in the group of this one
+    bool shares_blocks() const;
+
+    // adopt:
+    // ~ merges the groups of this arena and other, then takes over the
+    // free slots of other, leaving it empty
+    void adopt(Node_arena& other);
+
+    // resolve:
+    // ~ the arena behind a handle, a null handle (left by moving a tree)
+    // is given a new arena first
+    static Node_arena& resolve(std::unique_ptr<Node_arena>& handle);
+
+    // merge:
+    // ~ puts the arenas behind into and from in one group, so nodes of
+    // either may be handed to the other tree. Needed once nodes of two
+    // trees get mixed.
+    static void merge(std::unique_ptr<Node_arena>& into, std::unique_ptr<Node_arena>& from);
+
+    private:
+
+        // every block starts with this header, slots follow it
+        struct Block {
+            Block* next;
+            std::size_t bytes;
+            std::pmr::memory_resource* resource;
+        };
+
+        // recycled slots are linked through their own storage
+        struct Free_slot {
+            Free_slot* next;
+        };
+
+        // Slabs:
+        // the blocks of a group of arenas. Merged groups forward to the
+        // one holding the blocks, which counts the arenas using it.
+        struct Slabs {
+            Block* blocks = nullptr;
+            std::shared_ptr<Slabs> forward;
+            std::size_t arenas = 1;
+        };
+
+        static constexpr std::size_t slot_align =
+            alignof(T) > alignof(Free_slot) ? alignof(T) : alignof(Free_slot);
+        static constexpr std::size_t slot_size =
+            ((sizeof(T) > sizeof(Free_slot) ? sizeof(T) : sizeof(Free_slot)) + slot_align - 1) / slot_align * slot_align;
+        static constexpr std::size_t header_size =
+            (sizeof(Block) + slot_align - 1) / slot_align * slot_align;
+
+        // first block holds 64 slots, then blocks double up to max_block_slots
+        static constexpr std::size_t first_block_slots = 64;
+        static constexpr std::size_t max_block_slots = 65536;
+
+        // grow:
+        // ~ requests a block with room for at least n slots
+        void grow(std::size_t n);
+
+        // add_block:
+        // ~ a new block of the given size, linked into the group
+        Block* add_block(std::size_t bytes);
+
+        // join_groups:
+        // ~ puts this arena and other in the same group
+        void join_groups(Node_arena& other);
+
+        // root_of:
+        // ~ the group slabs belongs to, with slabs repointed there so
+        // chains of forwards stay short. Called under slabs_lock.
+        static Slabs& root_of(std::shared_ptr<Slabs>& slabs);
+
+        // free_blocks:
+        // ~ hands every block of a list back to its resource
+        static void free_blocks(Block* b);
+
+        // guards every group: their block lists, forwards and counts
+        static inline std::mutex slabs_lock;
+
+        std::pmr::memory_resource* upstream;
+        std::shared_ptr<Slabs> slabs;
+        Free_slot* free_list;
+        char* cursor;
+        char* limit;
+        std::size_t next_block_slots;
+};
+
+// Subtree_size <Enabled>:
+// node count of a subtree, stored in every node when Enabled and empty
+// otherwise, so trees without order statistics pay nothing for it
+template <bool Enabled> struct Subtree_size {
+    std::size_t size = 1;
+};
+
+template <> struct Subtree_size<false> {};
+
+// Subtree_aggregate <Aggregate>:
+// Aggregate (monoid) : combination of the entries of a subtree, see below.
+// Empty for void, so trees without an aggregate pay nothing for it.
+template <typename Aggregate> struct Subtree_aggregate {
+    typename Aggregate::value_type aggregate;
+};
+
+template <> struct Subtree_aggregate<void> {};
+
+// Owned_pointer, Borrowed_pointer <T>:
+// the two ownership policies of a key or value of type T. An owned one is
+// handed to release() when its node is destroyed, a borrowed one is left
+// alone.
+template <typename T> struct Owned_pointer {
+    static constexpr bool owned = true;
+    static void release(T p) { delete p; }
+};
+
+template <typename T> struct Borrowed_pointer {
+    static constexpr bool owned = false;
+    static void release(T) {}
+};
+
+// Ownership <T>:
+// the policy trees apply to keys and values of type T. Raw pointers are
+// owned (deleted with their node), anything else is borrowed, as trees
+// always did. Specialize it to change that for a type:
+//     template <> struct Ownership<Widget*> : Borrowed_pointer<Widget*> {};
+//     template <> struct Ownership<FILE*> { static constexpr bool owned = true;
+//                                          static void release(FILE* f) { std::fclose(f); } };
+template <typename T>
+struct Ownership : std::conditional_t<std::is_pointer<T>::value, Owned_pointer<T>, Borrowed_pointer<T>> {};
+
+// No_value:
+// the value of a key only tree (Red_black_set below). Empty, so entries
+// and nodes hold the key and nothing else.
+struct No_value {
+    friend bool operator==(No_value, No_value) { return true; }
+    friend bool operator!=(No_value, No_value) { return false; }
+};
+
+// Value_sum, Value_min, Value_max <T>:
+// stock aggregates over the values of a tree. An Aggregate provides
+// value_type, identity(), lift(key, val) for one entry and an associative
+// combine(a, b), a holding the lesser keys. combine need not commute.
+template <typename T> struct Value_sum {
+    using value_type = T;
+    static T identity() { return T{}; }
+    template <typename K> static T lift(const K&, const T& v) { return v; }
+    static T combine(const T& a, const T& b) { return a + b; }
+};
+
+template <typename T> struct Value_min {
+    using value_type = T;
+    static T identity() { return std::numeric_limits<T>::max(); }
+    template <typename K> static T lift(const K&, const T& v) { return v; }
+    static T combine(const T& a, const T& b) { return b < a ? b : a; }
+};
+
+template <typename T> struct Value_max {
+    using value_type = T;
+    static T identity() { return std::numeric_limits<T>::lowest(); }
+    template <typename K> static T lift(const K&, const T& v) { return v; }
+    static T combine(const T& a, const T& b) { return a < b ? b : a; }
+};
+
+// Value_is_end:
+// end point projection of an interval tree whose values are the ends
+struct Value_is_end {
+    template <typename K, typename V>
+    const V& operator()(const K&, const V& v) const { return v; }
+};
+
+// Interval_end <T,End>:
+// aggregate of interval trees: entries are intervals [key, end) with
+// end = End{}(key, val), a subtree keeps its greatest end. T needs
+// std::numeric_limits (lowest() is the identity).
+template <typename T, typename End = Value_is_end> struct Interval_end {
+    using value_type = T;
+    static T identity() { return std::numeric_limits<T>::lowest(); }
+    template <typename K, typename V> static T lift(const K& k, const V& v) { return End{}(k, v); }
+    static T combine(const T& a, const T& b) { return a < b ? b : a; }
+};
+
+// is_interval_aggregate:
+// whether an aggregate makes an interval tree
+template <typename A> struct is_interval_aggregate : std::false_type {};
+template <typename T, typename End> struct is_interval_aggregate<Interval_end<T, End>> : std::true_type {};
+
+// Snapshot_header:
+// start of a binary snapshot (see write_snapshot). The records follow at
+// records_offset, in key order. Files are only read back on machines with
+// the same byte order and type sizes, which the header lets readers check.
+struct Snapshot_header {
+    static constexpr char signature[8] = {'R', 'B', 'T', 'S', 'N', 'A', 'P', '\0'};
+    static constexpr std::uint32_t current_version = 1;
+    static constexpr std::uint32_t native_byte_order = 0x01020304;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint64_t key_size;
+    std::uint64_t value_size;
+    std::uint64_t record_size;
+    std::uint64_t count;
+    std::uint64_t records_offset;
+};
+
+// Snapshot_record <K,V>:
+// one entry of a binary snapshot, named like std::pair so a range of
+// records feeds straight into from_sorted
+template <typename K, typename V> struct Snapshot_record {
+    K first;
+    V second;
+};
+
+// Frozen_index <K,V,Compare>:
+// read only copy of a tree, see freeze() and FrozenIndex.h
+template <typename K, typename V, typename Compare = std::less<K>> struct Frozen_index;
+
+// Red_black_tree <K,V,Compare,Order_statistics,Aggregate>:
+// K (data type) : With an ordering defined by Compare,
 // K is utilized for comparing the keys in the red black tree
 // V (data type) : Stores the values of the red black tree
+// Compare (function object) : strict weak ordering of the keys, std::less<K>
+// by default. A transparent Compare (one declaring is_transparent, such as
+// std::less<>) also enables lookups by any type it can order against K.
+// Order_statistics (flag) : every node also counts its subtree, which adds
+// rank, select, count and size in O(log n) for one extra word per node.
+// Aggregate (monoid or void) : every node also keeps the combination of its
+// subtree, which adds reduce(lo, hi) in O(log n). Values must then only be
+// changed through insert, a write through find() or an iterator is not seen.
 //
 // The red-black tree data structure consists of a self-balancing
 // binary tree, which ensures a log(n) runtime for analysis operations
-template <typename K, typename V> struct Red_black_tree {
+template <typename K, typename V, typename Compare = std::less<K>, bool Order_statistics = false,
+          typename Aggregate = void> struct Red_black_tree {
+
+    private:
+        struct Node;
+
+    public:
+
+    // Entry struct:
+    // ~ the key value pair stored by every node, what iterators point to.
+    // The key is const, moving it would break the ordering. An empty V
+    // (No_value) takes no room.
+    struct Entry {
+        const K key;
+        RBTREE_NO_UNIQUE_ADDRESS V val;
+    };
+
+    // basic_iterator <Const>:
+    // ~ bidirectional in-order iterator over the entries of the tree.
+    // Steps follow the parent links, so they cost amortized O(1) and
+    // never allocate. end() is NIL, stepping back from it lands on the maximum.
+    template <bool Const> struct basic_iterator {
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type        = Entry;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = std::conditional_t<Const, const Entry*, Entry*>;
+        using reference         = std::conditional_t<Const, const Entry&, Entry&>;
+
+        basic_iterator() = default;
+
+        // a mutable iterator converts into a const one
+        template <bool C = Const, typename = std::enable_if_t<C>>
+        basic_iterator(const basic_iterator<false>& other);
+
+        reference operator*() const;
+        pointer operator->() const;
+
+        basic_iterator& operator++();
+        basic_iterator operator++(int);
+        basic_iterator& operator--();
+        basic_iterator operator--(int);
+
+        bool operator==(const basic_iterator& other) const;
+        bool operator!=(const basic_iterator& other) const;
+
+        private:
+            friend struct Red_black_tree;
+
+            basic_iterator(Node* n, const Red_black_tree* t);
+
+            Node* node = nullptr;
+            const Red_black_tree* tree = nullptr;
+    };
+
+    using iterator       = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
 
     // constructor:
     // ~ initializes an empty tree
     Red_black_tree();
 
+    // constructor overload 1:
+    // ~ initializes an empty tree whose nodes are allocated from
+    // blocks of the given memory resource
+    explicit Red_black_tree(std::pmr::memory_resource* resource);
+
+    // constructor overload 2:
+    // ~ initializes an empty tree ordered by the given comparator
+    explicit Red_black_tree(const Compare& comp,
+                            std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
     // destructor:
-    // ~ deletes the tree
+    // ~ deletes the tree, as clear() does
     ~Red_black_tree();
 
+    // copy constructor:
+    // ~ a deep copy, as clone(): O(n), no comparisons, no rebalancing.
+    // Copies, copy assignment and clone() do not compile when K or V is
+    // owned (see Ownership): both trees would release the same pointers.
+    Red_black_tree(const Red_black_tree& other);
+
+    // copy assignment:
+    // ~ clones other, then swaps the clone in (this is unchanged if a copy throws)
+    Red_black_tree& operator=(const Red_black_tree& other);
+
+    // move constructor, move assignment:
+    // ~ O(1), the nodes change hands without being touched. other is left
+    // empty, its next nodes coming from the default memory resource.
+    Red_black_tree(Red_black_tree&& other) noexcept;
+    Red_black_tree& operator=(Red_black_tree&& other) noexcept;
+
+    // swap:
+    // ~ exchanges the contents (nodes, arenas, comparators) in O(1)
+    void swap(Red_black_tree& other) noexcept;
+
+    friend void swap(Red_black_tree& a, Red_black_tree& b) noexcept {
+        a.swap(b);
+    }
+
+    // clone:
+    // ~ a deep copy with the same shape and colors, built in O(n) with no
+    // comparisons and no rotations. All nodes go in one allocation, in the
+    // preorder of this tree. threads > 1 copies disjoint subtrees
+    // concurrently (K and V copies that cannot throw only, sequential otherwise).
+    Red_black_tree clone(unsigned threads = 1) const;
+
+    // from_sorted:
+    // ~ builds a tree from the key value pairs (p.first, p.second) in
+    // [first, last), which must be strictly increasing by key.
+    // Runs in O(n): no comparisons, no rotations, one allocation.
+    // The result is perfectly balanced, with only the incomplete last level red.
+    // threads > 1 builds disjoint subtrees concurrently (random access
+    // input whose K and V copies cannot throw only, sequential otherwise).
+    template <typename It>
+    static Red_black_tree from_sorted(It first, It last, unsigned threads = 1);
+
+    // assign_sorted:
+    // ~ replaces the content of the tree by the sorted range, as from_sorted
+    template <typename It>
+    void assign_sorted(It first, It last, unsigned threads = 1);
+
     // insert:
     // ~ the insert operation adds the key value pair k,v
-    // to the tree
+    // to the tree, replacing the value if k is already there. An owned
+    // value replaced, and an owned key equal to one in the tree, are
+    // released then (see Ownership).
+    // A key above (below) every other one is placed after one or two
+    // comparisons (the tree keeps fingers on its greatest and least nodes),
+    // so increasing or decreasing keys cost O(1) comparisons each.
     void insert(const K& k, const V& v);
+    void insert(K&& k, V&& v);
+
+    // insert overload (key only):
+    // ~ adds k, for trees whose V is empty (Red_black_set)
+    template <typename VV = V, typename = std::enable_if_t<std::is_empty<VV>::value>>
+    void insert(const K& k);
+
+    // insert overload (hinted):
+    // ~ insert, hint being the entry right after where k goes (as for
+    // std::map::emplace_hint), end() for keys at or near the back. A right
+    // hint costs O(1) comparisons, a key d entries before end() or after the
+    // hint O(log d), a wrong one a plain insert. Returns the entry of k.
+    iterator insert(const_iterator hint, const K& k, const V& v);
+    iterator insert(const_iterator hint, K&& k, V&& v);
+
+    // emplace:
+    // ~ builds the node in place, the key from k and the value from args,
+    // then links it unless the key is already there (the node is dropped then).
+    // Returns the entry holding the key and whether it was inserted.
+    template <typename KK, typename... Args>
+    std::pair<iterator, bool> emplace(KK&& k, Args&&... args);
+
+    // emplace_hint:
+    // ~ emplace, placed with a hint as the hinted insert is
+    template <typename KK, typename... Args>
+    iterator emplace_hint(const_iterator hint, KK&& k, Args&&... args);
+
+    // try_emplace:
+    // ~ like emplace, but nothing is built when k is already there,
+    // so args are left untouched
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const K& k, Args&&... args);
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(K&& k, Args&&... args);
+
+    // insert_batch:
+    // ~ inserts the key value pairs (p.first, p.second) of [first, last) as
+    // insert would, in any order; of two pairs with the same key the later wins.
+    // The batch is sorted and merged in one ordered pass: every key is looked
+    // up from the node of the previous one, climbing only as far as needed,
+    // instead of from the root. threads > 1 cuts large batches into key ranges,
+    // splits the tree along them, fills the parts concurrently and joins them back.
+    // Returns how many keys were not in the tree yet.
+    template <typename It>
+    std::size_t insert_batch(It first, It last, unsigned threads = 1);
 
     // remove:
-    // ~ the remove operation takes the node attributed to
-    // the key value pair specified by a given k.
-    void remove(const K& k);                                                                                // TODO
+    // ~ removes the entry of k, returns whether there was one. At most three
+    // rotations; the node goes to the free list of the arena, where the next
+    // insert takes it from instead of allocating.
+    bool remove(const K& k);
+
+    // erase:
+    // ~ removes the entry at pos (not end()) as remove does, returns the
+    // entry after it
+    iterator erase(const_iterator pos);
+
+    // erase_range:
+    // ~ removes every entry with lo <= key < hi: two splits and a join, so
+    // O(log n) rebalancing however many entries go, then the removed nodes
+    // are destroyed and recycled one by one. Returns how many were removed.
+    std::size_t erase_range(const K& lo, const K& hi);
+
+    // erase_batch:
+    // ~ removes the keys of [first, last) (any order, repeats allowed) that are
+    // in the tree. The middle key of the sorted batch splits the tree, both
+    // halves are solved independently and joined back: O(m log(n/m + 1)) for
+    // m keys, halves forked onto threads as in the set algebra.
+    // Returns how many keys were removed.
+    template <typename It>
+    std::size_t erase_batch(It first, It last, unsigned threads = 1);
+
+    // clear:
+    // ~ removes every entry, the tree stays usable. Node destructors only
+    // run when K, V or the Ownership policy need them, then the node blocks
+    // go back to the memory resource all at once: O(blocks) for trivially
+    // destructible entries, O(n) with O(1) stack otherwise.
+    void clear();
 
     // join:
-    // ~ given two Trees T1, T2, with T1 having strictly lesser keys than
-    // ~ T2. Outputs one tree containing both's keys
-    static Red_black_tree<K, V> join(const Red_black_tree<K, V>* T1, const Red_black_tree<K, V>* T2);       // TODO
+    // ~ given this tree T1 and a tree T2, with T1 having strictly lesser keys than
+    // ~ T2. Moves every key of T2 into T1 in O(log n), T2 is left empty.
+    void join(Red_black_tree& T2);
 
     // split:
-    // Given a tree T and a key K, returns two trees T1, T2, where T1 keys are
-    // lesser or equal than k, but T2 keys are strictly greater than k
-    static Red_black_tree<K, V> split(const Red_black_tree<K, V>* T, const K& k);                                       // TODO
+    // Given this tree T and a key k, keeps in T the keys lesser or equal than k
+    // and moves the ones strictly greater than k into T2 (emptied first), in O(log n).
+    // The node blocks of both trees are shared afterwards (see Node_arena),
+    // each tree can still be modified on its own thread.
+    void split(const K& k, Red_black_tree& T2);
+
+    // SET ALGEBRA
+    // join based divide and conquer: the root of one side splits the other,
+    // both halves are solved independently and joined back around that root.
+    // O(m log(n/m + 1)) work for sizes m <= n. With threads > 1 the two halves
+    // are forked onto separate threads while there are threads to spare.
+    // The nodes of other are consumed, other is left empty.
+
+    // union_with:
+    // ~ this becomes this U other, keeping this tree's value on equal keys
+    void union_with(Red_black_tree& other, unsigned threads = 1);
+
+    // intersect_with:
+    // ~ this becomes this n other, with this tree's values
+    void intersect_with(Red_black_tree& other, unsigned threads = 1);
+
+    // difference_with:
+    // ~ this becomes this \ other
+    void difference_with(Red_black_tree& other, unsigned threads = 1);
 
     // MINIMUM AND MAXIMUM SEARCH FUNCTIONS
-    // Theorem: leftmost and rightmost node are respectively the least and greatest keys from a
-    // set of keys inserted in the tree.
-    // proof by contradiction. (k is leftmost -> k is least)
-    // Assume k is leftmost but then it is not the least.
-    // Assume it is placed in any binary tree T.
-    // WLOG, assume we have placed all the
-    V val_at_min();
+    // The tree keeps its leftmost and rightmost nodes (least and greatest
+    // keys) at hand, so these read one node, no descent. On an empty tree
+    // they return K() and V().
+
+    // val_at_min, val_at_max:
+    // ~ value of the least and greatest key
+    V val_at_min() const;
 
-    V val_at_max();
+    V val_at_max() const;
 
-    K min_key();
+    // min_key, max_key:
+    // ~ least and greatest key
+    K min_key() const;
 
-    K max_key();
+    K max_key() const;
+
+    // pop_min, pop_max:
+    // ~ removes the entry of the least (greatest) key and returns it, nullopt
+    // when the tree is empty. The node is a leaf or has one red leaf below
+    // it, so the unlink is O(1) and the rebalancing amortized O(1); the new
+    // extreme is its neighbour, found in amortized O(1) too.
+    // Owned keys and values (see Ownership) go to the caller with the
+    // entry: the tree does not release them, whoever pops them does.
+    std::optional<std::pair<K, V>> pop_min();
+
+    std::optional<std::pair<K, V>> pop_max();
 
     // previous:
     // previous(T,k) = max{ h | h < k, h in T }
-    V previous(const K &k);                                                                          // TODO
+    // ~ end() if there is no such h
+    iterator previous(const K &k);
 
-    // previous:
-    // previous(T,k) = min{ h | h > k, h in T }
-    V next(const K &k);                                                                              // TODO
+    // next:
+    // next(T,k) = min{ h | h > k, h in T }
+    // ~ end() if there is no such h
+    iterator next(const K &k);
+
+    // begin, end:
+    // ~ in-order traversal bounds, begin is the minimum (O(1), cached)
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+
+    // lower_bound:
+    // ~ first entry whose key is not less than k
+    iterator lower_bound(const K& k);
+    const_iterator lower_bound(const K& k) const;
+    template <typename Q, typename C = Compare, typename = typename C::is_transparent>
+    iterator lower_bound(const Q& k);
+    template <typename Q, typename C = Compare, typename = typename C::is_transparent>
+    const_iterator lower_bound(const Q& k) const;
+
+    // upper_bound:
+    // ~ first entry whose key is greater than k
+    iterator upper_bound(const K& k);
+    const_iterator upper_bound(const K& k) const;
+    template <typename Q, typename C = Compare, typename = typename C::is_transparent>
+    iterator upper_bound(const Q& k);
+    template <typename Q, typename C = Compare, typename = typename C::is_transparent>
+    const_iterator upper_bound(const Q& k) const;
+
+    // equal_range:
+    // ~ the pair (lower_bound(k), upper_bound(k))
+    std::pair<iterator, iterator> equal_range(const K& k);
+    std::pair<const_iterator, const_iterator> equal_range(const K& k) const;
+
+    // for_each_in_range:
+    // ~ calls fn(key, val) for every entry with lo <= key < hi, in order.
+    // Costs O(log n + k) for k visited entries and does not allocate.
+    template <typename Fn>
+    void for_each_in_range(const K& lo, const K& hi, Fn&& fn);
 
     // find:
     // ~ the find operation retrieves the associated value to
-    // given key k
-    V find(K k);
+    // given key k, by pointer (nullptr if k is not in the tree)
+    V* find(const K& k);
+    const V* find(const K& k) const;
+    template <typename Q, typename C = Compare, typename = typename C::is_transparent>
+    V* find(const Q& k);
+    template <typename Q, typename C = Compare, typename = typename C::is_transparent>
+    const V* find(const Q& k) const;
+
+    // find_batch:
+    // ~ find for every key of [first, last) (forward iterators), writing one
+    // value pointer per key to out, in the same order (nullptr on a miss).
+    // Returns the number of hits. The searches go down in groups of
+    // find_width, one level per round, and each prefetches its next node, so
+    // the cache misses of different keys overlap instead of queueing up: on
+    // trees much bigger than the cache this beats a loop of find.
+    template <typename It, typename Out>
+    std::size_t find_batch(It first, It last, Out out);
+    template <typename It, typename Out>
+    std::size_t find_batch(It first, It last, Out out) const;
+
+    // contains:
+    // ~ whether k is in the tree
+    bool contains(const K& k) const;
+    template <typename Q, typename C = Compare, typename = typename C::is_transparent>
+    bool contains(const Q& k) const;
+
+    // ORDER STATISTICS (Order_statistics trees only)
+
+    // rank:
+    // ~ how many keys are less than k
+    template <bool O = Order_statistics, typename = std::enable_if_t<O>>
+    std::size_t rank(const K& k) const;
+
+    // select:
+    // ~ the entry with i lesser keys (0 is the minimum), end() if i >= size()
+    template <bool O = Order_statistics, typename = std::enable_if_t<O>>
+    iterator select(std::size_t i);
+    template <bool O = Order_statistics, typename = std::enable_if_t<O>>
+    const_iterator select(std::size_t i) const;
+
+    // count:
+    // ~ how many keys fall in [lo, hi)
+    template <bool O = Order_statistics, typename = std::enable_if_t<O>>
+    std::size_t count(const K& lo, const K& hi) const;
+
+    // size:
+    // ~ number of entries, O(1)
+    template <bool O = Order_statistics, typename = std::enable_if_t<O>>
+    std::size_t size() const;
+
+    // AGGREGATES (trees with an Aggregate only)
+
+    // reduce:
+    // ~ the combination, in key order, of the entries with lo <= key < hi
+    // (identity if there is none). O(log n)
+    template <typename A = Aggregate, typename = std::enable_if_t<!std::is_void<A>::value>>
+    typename A::value_type reduce(const K& lo, const K& hi) const;
+
+    // reduce: (whole tree)
+    // ~ the combination of every entry, O(1)
+    template <typename A = Aggregate, typename = std::enable_if_t<!std::is_void<A>::value>>
+    typename A::value_type reduce() const;
+
+    // INTERVALS (trees with an Interval_end aggregate only)
+    // every entry is the interval [key, end). Two intervals overlap when
+    // each one starts before the other ends.
+
+    // find_any_overlap:
+    // ~ some entry overlapping [lo, hi), end() if none does. O(log n)
+    template <typename A = Aggregate, typename = std::enable_if_t<is_interval_aggregate<A>::value>>
+    iterator find_any_overlap(const K& lo, const K& hi);
+    template <typename A = Aggregate, typename = std::enable_if_t<is_interval_aggregate<A>::value>>
+    const_iterator find_any_overlap(const K& lo, const K& hi) const;
+
+    // for_each_overlap:
+    // ~ calls fn(key, val) for every entry overlapping [lo, hi), by key order.
+    // Only subtrees that can hold an overlap are entered: O(log n) when there
+    // is none, O(log n) per reported entry at worst.
+    template <typename Fn, typename A = Aggregate, typename = std::enable_if_t<is_interval_aggregate<A>::value>>
+    void for_each_overlap(const K& lo, const K& hi, Fn&& fn);
 
     enum order { INORDER, PREORDER, POSTORDER};
     // to_string:
     // returns representation based on given argument
-    std::string to_string(order print);
+    std::string to_string(order print) const;
+
+    // write_to:
+    // ~ streams the representation to_string returns, without building it.
+    // Iterative, so the stack does not grow with the tree. Keys and values
+    // are written with operator<<, a Red_black_set writes its keys only.
+    void write_to(std::ostream& out, order print) const;
+
+    // SHAPE AND CHECKS
+    // O(n) walks that follow the parent links, so they use no stack even
+    // on a tree that has lost its balance.
+
+    // height:
+    // ~ nodes on the longest root to leaf path, 0 when empty. A valid
+    // tree of n entries stays within 2 log2(n + 1).
+    std::size_t height() const;
+
+    // black_height:
+    // ~ black nodes on every root to NIL path, O(log n)
+    std::size_t black_height() const;
+
+    // average_depth:
+    // ~ mean number of nodes a successful lookup visits (the root counts
+    // as 1), 0 when empty. About log2(n) - 1 in a well shaped tree.
+    double average_depth() const;
+
+    // validate:
+    // ~ whether every color invariant listed below holds, plus the search
+    // order of the keys, the parent links and the subtree sizes (with
+    // Order_statistics), that the shared NIL is untouched and that the
+    // append finger sits on the greatest node. Stops at the first violation.
+    bool validate() const;
+
+    // freeze:
+    // ~ immutable, contiguous copy of the tree laid out for lookups and
+    // scans, O(n). The tree itself is left as it is. Needs FrozenIndex.h.
+    // Owned keys and values stay the tree's: the index borrows them and
+    // must not outlive it.
+    Frozen_index<K, V, Compare> freeze() const;
+
+    // key_comp:
+    // ~ the comparator ordering the keys
+    Compare key_comp() const;
+
+    // write_snapshot:
+    // ~ binary image of the tree: a Snapshot_header, then one
+    // Snapshot_record per entry in key order. Trivially copyable, non pointer
+    // K and V only. Returns whether out took everything.
+    // Load it back with Mapped_snapshot (MappedSnapshot.h).
+    bool write_snapshot(std::ostream& out) const;
 
 
     private:
@@ -93,18 +861,36 @@ template <typename K, typename V> struct Red_black_tree {
         static constexpr bool red   = true;
         static constexpr bool black = false;
 
-        // defective_tree flags the possibility of the tree not being built correctly
-        // it also is a tool in balancing cases where the tree has to be balanced up to down
-        // or in deletion cases.
-        bool defective_tree;
-
         static constexpr bool is_pointer_K = std::is_pointer<K>::value;
         static constexpr bool is_pointer_V = std::is_pointer<V>::value;
-        static constexpr bool is_destructible_K = std::is_destructible<K>::value;
-        static constexpr bool is_destructible_V = std::is_destructible<V>::value;
+        // whether destroying a node releases its key, respectively value
+        static constexpr bool owns_K = Ownership<K>::owned;
+        static constexpr bool owns_V = Ownership<V>::owned;
+
+        // entries can be written as raw bytes and read back as they are
+        static constexpr bool snapshot_ready =
+            std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value
+            && !is_pointer_K && !is_pointer_V;
+
+        // keys ordered by a built in comparison: searches select the next
+        // node instead of branching on it (see find_node)
+        static constexpr bool branchless_keys =
+            std::is_arithmetic<K>::value
+            && (std::is_same<Compare, std::less<K>>::value || std::is_same<Compare, std::greater<K>>::value
+                || std::is_same<Compare, std::less<>>::value || std::is_same<Compare, std::greater<>>::value);
+
+        // nodes only need to be visited one by one on teardown when
+        // destroying them actually does something
+        static constexpr bool trivial_node_teardown =
+            std::is_trivially_destructible<K>::value && std::is_trivially_destructible<V>::value
+            && std::is_trivially_destructible<Subtree_aggregate<Aggregate>>::value
+            && !owns_K && !owns_V;
         // Node struct:
         // ~ key : used as identifier of information
-        struct Node {
+        // The Entry base comes first, so the key sits at offset 0 next to
+        // the links the search loop follows. Subtree_size and Subtree_aggregate
+        // are empty unless Order_statistics, respectively Aggregate, are set.
+        struct Node : Entry, Subtree_size<Order_statistics>, Subtree_aggregate<Aggregate> {
 
             // Default constructor
             Node(const K& k, const V& v);
@@ -113,99 +899,421 @@ template <typename K, typename V> struct Red_black_tree {
             Node(const K& k, const V& v, Node* left, Node* right);
             Node(const K &k, const V &v, Node *left, Node *right, bool color);
 
-            // recursive deletion
+            // overload 3, key built from k and value from args in place
+            template <typename KK, typename... Args>
+            Node(std::in_place_t, KK&& k, Args&&... args);
+
+            // deletion of the owned key value pair
+            // (children belong to the arena, not to the node)
             ~Node();
 
-            // to_string method
-            std::string to_string();
+            // parent, set_parent:
+            // parent node pointer (parent of the root is NIL)
+            Node* parent() const;
+            void set_parent(Node* P);
 
-            // Key value pair fields
-            K key;
-            V val;
+            // color, set_color:
+            // color invariant, kept in the low bit of the parent link
+            bool color() const;
+            void set_color(bool c);
+
+            // pack:
+            // parent pointer and color in one word. Nodes are at least
+            // pointer aligned, so bit 0 of a node address is always free.
+            static std::uintptr_t pack(Node* P, bool c);
 
             // Left and right node pointers
             Node* right;
             Node* left;
 
-            // color invariant
-            bool color;
+            // parent pointer | color bit
+            std::uintptr_t parent_color;
+        };
 
 
-        };
+        // pool hands out the storage of every node in the tree. Its blocks
+        // are shared with the trees this one exchanged nodes with.
+        std::unique_ptr<Node_arena<Node>> pool;
+
+        // arena method:
+        // the arena behind pool, created if the tree was moved from
+        Node_arena<Node>& arena();
+
+        // make_node method:
+        // constructs a node from the arena
+        template <typename... Args>
+        Node* make_node(Args&&... args);
+
+        // drop_node method:
+        // destroys a node that never made it into the tree
+        void drop_node(Node* N);
+
+        // forget_node:
+        // drop_node for a node whose key and value were handed out: they
+        // are destroyed without going through the Ownership policy
+        void forget_node(Node* N);
+
+        // make_field:
+        // a T built from args and returned as a prvalue, so it initializes
+        // a node field directly. Scalars only take implicit conversions.
+        template <typename T, typename... Args>
+        static T make_field(Args&&... args);
+
+        // comp: the key ordering
+        // comparisons are counted when Tree_stats is enabled
+        using Key_order = std::conditional_t<Tree_stats::enabled, Counted_compare<Compare>, Compare>;
+        Key_order comp;
 
+        // dismantle method:
+        // calls visit(M) on every node M of the subtree of N, in key order,
+        // once M is unlinked (visit may destroy it). Left children are rotated
+        // up instead of kept on a stack: O(1) space whatever the height, and
+        // only child links are followed, so a tree with broken parent links
+        // still comes apart.
+        template <typename Visit>
+        static void dismantle(Node* N, Visit&& visit);
 
-        // POOL is a temporary storage and retrieval for
-        // node deletion.
-        Node* POOL = new Node[64];
+        // destroy_subtree method:
+        // runs the node destructors of a whole subtree, storage is left
+        // to the arena
+        static void destroy_subtree(Node* N);
 
-        // dump_pool method:
-        // dumps the pool content by permanent deletion
-        void dump_pool();
+        // recycle_subtree method:
+        // destroys a whole subtree and gives its slots back to the arena,
+        // returns how many nodes it had
+        static std::size_t recycle_subtree(Node* N, Node_arena<Node>& arena);
 
-        // retrieve pool method:
-        // reinserts the pool content
-        void retrieve_pool();
+        // teardown method:
+        // destroys every node and hands the arena blocks back, leaves an empty tree.
+        // An arena sharing its blocks with other trees gets the slots back one by one instead.
+        void teardown();
 
-        // retrieve_inidividual method:
-        // saves last node from the pool's content
-        void retrieve_individual();
+        // subtrees smaller than this are never split across threads
+        static constexpr std::size_t parallel_cutoff = 1 << 14;
+
+        // Sorted_tag:
+        // selects the private bulk loading constructor behind from_sorted
+        struct Sorted_tag {};
+
+        template <typename It>
+        Red_black_tree(Sorted_tag, It first, It last, unsigned threads);
+
+        // Initializer overload 3 (private):
+        // backs the copy constructor and clone
+        struct Clone_tag {};
+
+        Red_black_tree(Clone_tag, const Red_black_tree& other, unsigned threads);
+
+        // memory_resource:
+        // where the arena of this tree takes its blocks from
+        std::pmr::memory_resource* memory_resource() const;
+
+        // count_nodes:
+        // nodes in the subtree of N, read off N with order statistics,
+        // counted otherwise (the two subtrees concurrently while threads > 1)
+        static std::size_t count_nodes(Node* N, unsigned threads);
+
+        // copy_subtree:
+        // copies the subtree of S below parent in preorder, one slot per
+        // node from next on (next is advanced past every node built), and
+        // returns the copy of S
+        static Node* copy_subtree(Node* S, Node* parent, Node*& next);
+
+        // clone_subtree:
+        // copy_subtree into slots, the left subtree on another thread while
+        // there are threads to spare
+        static Node* clone_subtree(Node* S, Node* slots, Node* parent, unsigned threads);
+
+        // link_sorted method:
+        // links nodes[lo, hi) into a size balanced subtree below parent and
+        // returns its root. make(i) is called on a slot right before it is linked,
+        // nodes at red_depth are colored red, the rest black.
+        template <typename Make>
+        static Node* link_sorted(Node* nodes, std::size_t lo, std::size_t hi, std::size_t depth,
+                                 std::size_t red_depth, Node* parent, unsigned threads, const Make& make);
 
         // NIL node represents end of the tree: null value reference.
+        // One per instantiation, shared by every tree and every thread. It is
+        // built before main and only ever read afterwards, which is what makes
+        // separate trees safe to use from separate threads: no operation may
+        // write to it (not even its parent link or color), validate() checks.
         static Node* NIL;
 
+        // make_nil: builds NIL
+        static Node* make_nil();
+
         // root node to the tree
         Node* root;
 
-        // TODO (I am sleepy)
+        // leftmost, rightmost: the nodes of the least and greatest keys, NIL
+        // when empty. Fingers for min/max and appends, kept by link_node and
+        // erase_node and refreshed by whatever else reshapes the tree
+        // (adopt_piece, assign_sorted, teardown).
+        Node* leftmost;
+        Node* rightmost;
+
         // returns node at minimum position from node N
         static Node* minNode(Node* N);
 
-        // TODO (I am sleepy)
         // returns node at maximum position from node N
         static Node* maxNode(Node* N);
 
+        // successor, predecessor:
+        // in-order neighbours of N through the parent links (NIL if none)
+        static Node* successor(Node* N);
+        static Node* predecessor(Node* N);
+
+        // lower_bound_node, upper_bound_node:
+        // the nodes behind lower_bound and upper_bound, one comparison per level
+        template <typename Q>
+        Node* lower_bound_node(const Q& k) const;
+        template <typename Q>
+        Node* upper_bound_node(const Q& k) const;
+
+        // find_node:
+        // the node holding k, NIL if absent
+        template <typename Q>
+        Node* find_node(const Q& k) const;
+
+        // find_width: searches find_batch keeps in flight. Enough to cover a
+        // memory access with the work of the others, few enough that their
+        // state stays in registers and L1.
+        static constexpr std::size_t find_width = 16;
+
+        // find_nodes:
+        // the interleaved descent behind find_batch, emit(node) for every
+        // key in order, NIL for a miss
+        template <typename It, typename Emit>
+        void find_nodes(It first, It last, Emit&& emit) const;
+
+        // prefetch:
+        // asks for the cache lines of N holding its key and its links
+        static void prefetch(const Node* N);
+
+        // select_node:
+        // the node behind select, NIL if i >= size (order statistics only)
+        Node* select_node(std::size_t i) const;
+
+        // overlap_node:
+        // the node behind find_any_overlap, NIL if none (interval trees only)
+        Node* overlap_node(const K& lo, const K& hi) const;
+
+        // visit_overlaps:
+        // in-order walk of N behind for_each_overlap (interval trees only)
+        template <typename Fn>
+        void visit_overlaps(Node* N, const K& lo, const K& hi, Fn& fn);
+
+        // descend:
+        // looks for k from the root with one comparison per level. Returns
+        // the node holding k, or NIL together with the parent and side
+        // where a node for k has to be linked.
+        template <typename Q>
+        Node* descend(const Q& k, Node*& parent, bool& left_side) const;
+
+        // descend_from:
+        // descend for keys coming in increasing order: climbs from finger (the
+        // node of the previous key, NIL for the first one) to the lowest ancestor
+        // whose subtree can hold k, then descends from there. top is the root
+        // of the tree or piece being filled.
+        template <typename Q>
+        Node* descend_from(Node* finger, const Q& k, Node*& parent, bool& left_side, Node* top) const;
+
+        // locate:
+        // descend for the insert family: a key above the greatest one (below
+        // the least) is placed under rightmost (leftmost) after one
+        // comparison, others descend
+        template <typename Q>
+        Node* locate(const Q& k, Node*& parent, bool& left_side) const;
+
+        // locate_near:
+        // locate with a hint, the node right after k (NIL for end())
+        template <typename Q>
+        Node* locate_near(Node* hint, const Q& k, Node*& parent, bool& left_side) const;
+
+        // link_node:
+        // hangs the new red node N below parent and rebalances
+        void link_node(Node* N, Node* parent, bool left_side);
+
+        // link_below:
+        // link_node for any tree top, returns whether its black height grew
+        static bool link_below(Node* N, Node* parent, bool left_side, Node*& top);
+
+        // release_dropped:
+        // releases what batch[i], a duplicate of a later pair in the sorted
+        // batch, owns and neither the tree nor a later pair of equal key holds
+        void release_dropped(std::vector<std::pair<K, V>>& batch, std::size_t i) const;
+
+        // insert_run:
+        // inserts the sorted, distinct pairs [first, last) (moved from) into the
+        // tree at top, new nodes taken from a. Counts new keys in added and
+        // returns how much the black height of top grew.
+        template <typename It>
+        std::size_t insert_run(Node*& top, It first, It last, Node_arena<Node>& a, std::size_t& added) const;
+
+        // assign_found:
+        // gives found (holding a key equal to k) the value v. Under the
+        // Ownership policy the value replaced is released, and so is k, which
+        // the tree was handed but does not keep, unless they are the very
+        // key and value found already holds.
+        template <typename VV>
+        static void assign_found(Node* found, const K& k, VV&& v);
+
+        // insert_or_assign:
+        // shared body of the insert overloads
+        template <typename KK, typename VV>
+        void insert_or_assign(KK&& k, VV&& v);
+
+        // insert_hinted:
+        // shared body of the hinted insert overloads
+        template <typename KK, typename VV>
+        iterator insert_hinted(Node* hint, KK&& k, VV&& v);
+
+        // try_emplace_key:
+        // shared body of the try_emplace overloads
+        template <typename KK, typename... Args>
+        std::pair<iterator, bool> try_emplace_key(KK&& k, Args&&... args);
 
-        // insert method:
-        // This overload is a helper function for the original insertion
-        static Node* insert(Node* N, const K &k, const V &v);
 
         // balance_insertion:
-        // This is a helper function to the insert helper method
-        // permits preserving the color invariance of the nodes
-        static Node* balance_insertion(Node* N, const K& k);
+        // This is a helper function to the insert method, walks up
+        // from the freshly linked red node N through the parent links
+        // and restores the color invariance of the nodes of the tree at top.
+        // Returns true when top had to be blackened (black height grew).
+        static bool balance_insertion(Node* N, Node*& top);
+
+        // detach_node:
+        // unlinks N from the tree and moves the fingers off it, N is left
+        // to the caller
+        void detach_node(Node* N);
 
-        // remove:
-        // This is a helper function to the original remove method
-        static Node* remove(Node* N, const K &k);   // TODO
+        // erase_node:
+        // detach_node, then recycles N
+        void erase_node(Node* N);
+
+        // unlink:
+        // takes N out of the tree at top and rebalances. N itself is left
+        // alone (links included), ready to be destroyed.
+        static void unlink(Node* N, Node*& top);
 
         // balance_removal:
-        // this is a helper function to the remove helper function
-        // maintains color imbalance after having removed one node
-        static Node* balance_removal(Node* N, Node* M);  // TODO
+        // This is a helper function to unlink: a black node was taken from
+        // the path to X, which now has one black node too few. X may be NIL,
+        // so its parent P comes along (NIL is shared, its parent link is
+        // never written). Restores the color invariance of the tree at top.
+        static void balance_removal(Node* X, Node* P, Node*& top);
+
+
+        // Piece struct:
+        // a detached subtree together with its black height (black nodes
+        // from top to NIL, top included, NIL excluded). The top may be red.
+        struct Piece {
+            Node* top;
+            std::size_t black_height;
+        };
+
+        // Graveyard struct:
+        // subtrees thrown away by the set algebra, chained through the parent
+        // link of their tops. Destroyed after the operation, so forked
+        // branches never touch the arena.
+        struct Graveyard {
+            Node* head = NIL;
+            Node* tail = NIL;
+
+            // bury: chains the subtree at N
+            void bury(Node* N);
+            // bury_node: chains N alone, its children are kept elsewhere
+            void bury_node(Node* N);
+            // append: moves the content of other at the end
+            void append(Graveyard& other);
+        };
+
+        // forking stops below this black height (about 2^8 nodes)
+        static constexpr std::size_t fork_black_height = 8;
+
+        // black_height:
+        // counts the black nodes down the left spine of N
+        static std::size_t black_height(Node* N);
+
+        // piece_of:
+        // the whole tree as a piece
+        Piece piece_of() const;
 
-        // remove_only_child_parent:
-        // deletes one node with at most one child
-        static Node* remove_only_child_parent(Node* P, Node* C);
+        // adopt_piece:
+        // makes P the content of the tree, root black and parentless
+        void adopt_piece(Piece P);
 
-        // remove_stressed_parent:
-        // deletes one node with two children
-        static Node* remove_stressed_parent(Node* P, Node* C);
+        // make_standalone:
+        // turns P into a valid tree on its own: no parent, black top
+        static void make_standalone(Piece& P);
 
+        // join: (private overload)
+        // L < x < R. Walks down the spine of the taller side to a black node
+        // of the shorter one's black height, hangs x there as a red node with
+        // the shorter tree as child and restores the color invariance upwards.
+        static Piece join(Piece L, Node* x, Piece R);
 
-        // join: TODO (I am sleepy)
-        // this overload to the public join function permits for the
-        // conjoining of nodes instead of trees.
-        static Red_black_tree<K, V> join(const Node* T1, const Node* T2);
+        // join_pieces:
+        // L < R without a middle node, the maximum of L is taken as x
+        static Piece join_pieces(Piece L, Piece R);
+
+        // split_last:
+        // detaches the maximum of T into last and returns the rest
+        static Piece split_last(Piece T, Node*& last);
+
+        // split: (private overload)
+        // splits T into the keys lesser and greater than k,
+        // returns the node holding k itself (NIL if absent)
+        static Node* split(Piece T, const K& k, Piece& lesser, Piece& greater, const Key_order& comp);
+
+        // union_pieces, intersect_pieces, difference_pieces:
+        // the divide and conquer recursions behind the set algebra
+        static Piece union_pieces(Piece A, Piece B, unsigned threads, Graveyard& grave, const Key_order& comp);
+        static Piece intersect_pieces(Piece A, Piece B, unsigned threads, Graveyard& grave, const Key_order& comp);
+        static Piece difference_pieces(Piece A, Piece B, unsigned threads, Graveyard& grave, const Key_order& comp);
+
+        // erase_pieces:
+        // the divide and conquer recursion behind erase_batch, [lo, hi) sorted
+        // and distinct. Counts the nodes buried in removed.
+        static Piece erase_pieces(Piece A, const K* lo, const K* hi, unsigned threads, Graveyard& grave,
+                                  const Key_order& comp, std::size_t& removed);
+
+        // empty_graveyard:
+        // recycles everything buried in grave
+        void empty_graveyard(Graveyard& grave);
+
+        // consume:
+        // shares arenas with other, empties it and hands it a fresh arena
+        Piece consume(Red_black_tree& other);
+
+        // nodes store something about their subtree
+        static constexpr bool has_aggregate = !std::is_void<Aggregate>::value;
+        static constexpr bool augmented = Order_statistics || has_aggregate;
+
+        // pull:
+        // recomputes what N stores about its subtree (size, aggregate) from
+        // its children. Every structural change calls it bottom-up; it
+        // compiles to nothing for trees that store neither.
+        static void pull(Node* N);
+
+        // pull_path:
+        // pull on N and every ancestor, after N's subtree changed
+        static void pull_path(Node* N);
 
         // rotate_right:
         // makes a node rotation, interchanging
-        // left node to the root
-        static Node* rotate_right(Node* N);
+        // left node to the root. The rotated subtree is hooked back
+        // into N's parent (or top, when N is the top) and its new top is returned.
+        static Node* rotate_right(Node* N, Node*& top);
 
         // rotate_left:
         // makes a node rotation, interchanging
-        // right node to the root
-        static Node* rotate_left(Node* N);
+        // right node to the root. The rotated subtree is hooked back
+        // into N's parent (or top, when N is the top) and its new top is returned.
+        static Node* rotate_left(Node* N, Node*& top);
+
+        // replace_child:
+        // makes now take the place of old below P (top if P is NIL)
+        static void replace_child(Node* P, Node* old, Node* now, Node*& top);
 
         // flip_color:
         // if red make N black, else make N red
@@ -223,11 +1331,31 @@ template <typename K, typename V> struct Red_black_tree {
         // left and right child exchange
         static void interchange_both_children_color(Node* N);
 
-        // private printing functions
-        static std::string preorder_print(Node* N);
-        static std::string postorder_print(Node* N);
-        static std::string inorder_print(Node* N);
+        // write_entry:
+        // (key,val) of N, just (key) in a Red_black_set
+        static void write_entry(std::ostream& out, const Node* N);
+
+        // walk_paths:
+        // calls visit(N, depth, blacks) on every node in pre-order, depth and
+        // blacks counting the nodes, respectively black nodes, from the root to
+        // N included. Stops and returns false as soon as visit does.
+        template <typename Visit>
+        bool walk_paths(Visit&& visit) const;
 };
 
+// Interval_tree <K,V,End,Compare>:
+// red black tree of intervals [key, End{}(key, val)), by default the value
+// is the end. Keys are the starts, so two intervals cannot start together.
+template <typename K, typename V, typename End = Value_is_end, typename Compare = std::less<K>>
+using Interval_tree = Red_black_tree<K, V, Compare, false, Interval_end<K, End>>;
+
+// Red_black_set <K,Compare,Order_statistics>:
+// ordered set of keys, a red black tree whose nodes hold no value (a
+// Red_black_set<long> node is 32 bytes, a std::set<long> one 40 plus the
+// allocator's header). insert(k), contains(k) and the rest work as for any
+// tree, iterators still show an (empty) val.
+template <typename K, typename Compare = std::less<K>, bool Order_statistics = false>
+using Red_black_set = Red_black_tree<K, No_value, Compare, Order_statistics>;
+
 #include "RBTree.impl.h"
 #endif //RBTREE_LIB_H
\ No newline at end of file
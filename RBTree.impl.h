@@ -8,395 +8,3117 @@
 // This is only available for C++ 17
 
 
+// STATS CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+inline void Tree_stats::count(Tree_event e, std::uint64_t n) {
+    if constexpr (enabled) {
+        counters[e].fetch_add(n, std::memory_order_relaxed);
+    }
+}
+
+inline Tree_stats::Counters Tree_stats::read() {
+    Counters c{};
+    for (std::size_t e = 0; e < tree_event_count; ++e) {
+        c[e] = counters[e].load(std::memory_order_relaxed);
+    }
+    return c;
+}
+
+inline void Tree_stats::reset() {
+    for (std::atomic<std::uint64_t>& c : counters) {
+        c.store(0, std::memory_order_relaxed);
+    }
+}
+
+inline const char* Tree_stats::name(Tree_event e) {
+    static constexpr const char* names[tree_event_count] = {
+        "key_comparisons", "left_rotations", "right_rotations", "recolors", "node_allocations",
+        "insertion_case_1", "insertion_case_2", "insertion_case_3", "insertion_case_4", "insertion_case_5",
+        "insertion_case_6", "insertion_case_7", "insertion_case_8", "insertion_case_9", "insertion_case_10",
+        "removal_case_1", "removal_case_2", "removal_case_3", "removal_case_4",
+    };
+    return e < tree_event_count ? names[e] : "unknown";
+}
+
+inline void Tree_stats::write_to(std::ostream& out) {
+    Counters c = read();
+    for (std::size_t e = 0; e < tree_event_count; ++e) {
+        out << "rbtree_" << name(static_cast<Tree_event>(e)) << ' ' << c[e] << '\n';
+    }
+}
+
+template<typename Compare>
+Counted_compare<Compare>::Counted_compare(const Compare& c) : order(c) {}
+
+template<typename Compare>
+template<typename A, typename B>
+bool Counted_compare<Compare>::operator()(const A& a, const B& b) const {
+    Tree_stats::count(key_comparisons);
+    return order(a, b);
+}
+
+
+// ARENA CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Constructor:
+// no block is requested until the first allocation.
+template<typename T>
+Node_arena<T>::Node_arena(std::pmr::memory_resource* r) {
+    upstream = r;
+    slabs = std::make_shared<Slabs>();
+    free_list = nullptr;
+    cursor = nullptr;
+    limit = nullptr;
+    next_block_slots = first_block_slots;
+}
+
+// Destructor:
+// the last arena out frees the blocks of the group
+template<typename T>
+Node_arena<T>::~Node_arena() {
+    Block* orphans = nullptr;
+    {
+        std::lock_guard<std::mutex> hold(slabs_lock);
+        Slabs& root = root_of(slabs);
+        if (--root.arenas == 0) {
+            orphans = std::exchange(root.blocks, nullptr);
+        }
+    }
+    free_blocks(orphans);
+}
+
+// allocate method:
+// free list first, bump pointer second, new block last.
+template<typename T>
+void* Node_arena<T>::allocate() {
+    Tree_stats::count(node_allocations);
+    if (free_list != nullptr) {
+        Free_slot* slot = free_list;
+        free_list = slot->next;
+        return slot;
+    }
+    if (cursor == limit) {
+        grow(next_block_slots);
+    }
+    void* p = cursor;
+    cursor += slot_size;
+    return p;
+}
+
+// recycle method:
+// the slot becomes the head of the free list
+template<typename T>
+void Node_arena<T>::recycle(void* p) {
+    Free_slot* slot = static_cast<Free_slot*>(p);
+    slot->next = free_list;
+    free_list = slot;
+}
+
+// allocate_array method:
+// a block of its own, so the bump pointer of the current block is untouched.
+// Slots are exactly sizeof(T) apart whenever T is at least pointer sized.
+template<typename T>
+T* Node_arena<T>::allocate_array(std::size_t n) {
+    static_assert(slot_size == sizeof(T), "array slots must be laid out as T[]");
+    Tree_stats::count(node_allocations, n);
+    Block* b = add_block(header_size + n * slot_size);
+    return reinterpret_cast<T*>(reinterpret_cast<char*>(b) + header_size);
+}
+
+// grow method:
+// whatever is left of the current block is simply abandoned, it is
+// given back together with the block on release.
+template<typename T>
+void Node_arena<T>::grow(std::size_t n) {
+    Block* b = add_block(header_size + n * slot_size);
+    cursor = reinterpret_cast<char*>(b) + header_size;
+    limit = cursor + n * slot_size;
+    if (next_block_slots < max_block_slots) {
+        next_block_slots *= 2;
+    }
+}
+
+// add_block method:
+// allocated outside the lock, only linking it into the group takes it
+template<typename T>
+typename Node_arena<T>::Block* Node_arena<T>::add_block(std::size_t bytes) {
+    Block* b = static_cast<Block*>(upstream->allocate(bytes, slot_align));
+    b->bytes = bytes;
+    b->resource = upstream;
+    std::lock_guard<std::mutex> hold(slabs_lock);
+    Slabs& root = root_of(slabs);
+    b->next = root.blocks;
+    root.blocks = b;
+    return b;
+}
+
+// release method:
+// one deallocation per block, the free list dies with the blocks. Blocks
+// other arenas still use stay with them and this arena starts a new group.
+template<typename T>
+void Node_arena<T>::release() {
+    Block* orphans = nullptr;
+    {
+        std::lock_guard<std::mutex> hold(slabs_lock);
+        Slabs& root = root_of(slabs);
+        if (root.arenas == 1) {
+            orphans = std::exchange(root.blocks, nullptr);
+        } else {
+            --root.arenas;
+            slabs = std::make_shared<Slabs>();
+        }
+    }
+    free_blocks(orphans);
+    free_list = nullptr;
+    cursor = nullptr;
+    limit = nullptr;
+    next_block_slots = first_block_slots;
+}
+
+template<typename T>
+std::pmr::memory_resource* Node_arena<T>::resource() const {
+    return upstream;
+}
+
+template<typename T>
+bool Node_arena<T>::shares_blocks() const {
+    std::lock_guard<std::mutex> hold(slabs_lock);
+    std::shared_ptr<Slabs> s = slabs;
+    return root_of(s).arenas > 1;
+}
+
+// adopt method:
+// the groups become one, then the free slots of other are pushed onto
+// ours one by one. The unused tail of other's current block is dropped
+// (it is returned together with its block).
+template<typename T>
+void Node_arena<T>::adopt(Node_arena& other) {
+    join_groups(other);
+    while (other.free_list != nullptr) {
+        Free_slot* slot = other.free_list;
+        other.free_list = slot->next;
+        recycle(slot);
+    }
+    other.cursor = nullptr;
+    other.limit = nullptr;
+}
+
+// resolve method:
+// only a moved from tree has no arena, it gets a fresh one
+template<typename T>
+Node_arena<T>& Node_arena<T>::resolve(std::unique_ptr<Node_arena>& handle) {
+    if (!handle) {
+        handle = std::make_unique<Node_arena>();
+    }
+    return *handle;
+}
+
+// merge method:
+// both arenas keep their free lists, only the blocks are pooled
+template<typename T>
+void Node_arena<T>::merge(std::unique_ptr<Node_arena>& into, std::unique_ptr<Node_arena>& from) {
+    resolve(into).join_groups(resolve(from));
+}
+
+// join_groups method:
+// the block list of the other group is spliced into ours and the other
+// group forwards here from now on
+template<typename T>
+void Node_arena<T>::join_groups(Node_arena& other) {
+    std::lock_guard<std::mutex> hold(slabs_lock);
+    Slabs& a = root_of(slabs);
+    Slabs& b = root_of(other.slabs);
+    if (&a == &b) {
+        return;
+    }
+    if (b.blocks != nullptr) {
+        Block* last = b.blocks;
+        while (last->next != nullptr) {
+            last = last->next;
+        }
+        last->next = a.blocks;
+        a.blocks = std::exchange(b.blocks, nullptr);
+    }
+    a.arenas += std::exchange(b.arenas, 0);
+    b.forward = slabs;
+    other.slabs = slabs;
+}
+
+// root_of method:
+// follows the forwards up to the group holding the blocks
+template<typename T>
+typename Node_arena<T>::Slabs& Node_arena<T>::root_of(std::shared_ptr<Slabs>& slabs) {
+    while (slabs->forward) {
+        std::shared_ptr<Slabs> next = slabs->forward;
+        slabs = next;
+    }
+    return *slabs;
+}
+
+template<typename T>
+void Node_arena<T>::free_blocks(Block* b) {
+    while (b != nullptr) {
+        Block* next = b->next;
+        b->resource->deallocate(b, b->bytes, slot_align);
+        b = next;
+    }
+}
+
+
 // NODE CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-template <typename K, typename V>
-typename Red_black_tree<K, V>::Node* Red_black_tree<K, V>::NIL = new Node(K{}, V{}, NULL, NULL, false);
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::NIL = make_nil();
+
+// make_nil:
+// the shared sentinel, black with null links. Built in place, so
+// move-only values are fine as long as they are default constructible.
+// It gets whole cache lines to itself: every tree on every thread reads it
+// on each step, so no other object may share (and keep dirtying) its line.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::make_nil() {
+    constexpr std::size_t line = 64;
+    constexpr std::size_t bytes = (sizeof(Node) + line - 1) / line * line;
+    void* slot = ::operator new(bytes, std::align_val_t(std::max(line, alignof(Node))));
+    Node* N = new (slot) Node(std::in_place, K{}, V{});
+    N->left = nullptr;
+    N->right = nullptr;
+    N->parent_color = Node::pack(nullptr, black);
+    if constexpr (Order_statistics) {
+        N->size = 0;
+    }
+    if constexpr (has_aggregate) {
+        N->aggregate = Aggregate::identity();
+    }
+    return N;
+}
 
 // Constructor overload 1:
 // Creates the default red key value pair node.
-template<typename K, typename V>
-::Red_black_tree<K, V>::Node::Node(const K &k, const V &v) {
-    key = k;
-    val = v;
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+::Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node::Node(const K &k, const V &v) : Entry{k, v} {
     left = NIL;
     right = NIL;
-    color = red;
+    parent_color = pack(NIL, red);
 }
 
 // Constructor overload 2:
 // creates the red key value pair node, with specified children.
-template<typename K, typename V>
-::Red_black_tree<K, V>::Node::Node(const K& k, const V& v, Node* l, Node* r) {
-    key = k;
-    val = v;
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+::Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node::Node(const K& k, const V& v, Node* l, Node* r) : Entry{k, v} {
     left = l;
     right = r;
-    color = red;
+    parent_color = pack(NIL, red);
 }
 
 
 // Constructor overload 3
 // creates a node with all fields specified.
-template<typename K, typename V>
-::Red_black_tree<K, V>::Node::Node(const K& k, const V& v, Node* l, Node* r, bool c) {
-    key = k;
-    val = v;
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+::Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node::Node(const K& k, const V& v, Node* l, Node* r, bool c) : Entry{k, v} {
     left = l;
     right = r;
-    color = c;
+    parent_color = pack(NIL, c);
 }
 
-// Deletion method
-// destroy node, associated key value pair, and all associated subtree.
-template<typename K, typename V>
-::Red_black_tree<K,V>::Node::~Node() {
+// Constructor overload 4
+// builds key and value in place, the node is red and childless.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename KK, typename... Args>
+::Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node::Node(std::in_place_t, KK&& k, Args&&... args)
+    : Entry{make_field<K>(std::forward<KK>(k)), make_field<V>(std::forward<Args>(args)...)} {
+    left = NIL;
+    right = NIL;
+    parent_color = pack(NIL, red);
+}
 
+// Deletion method
+// destroy node and associated key value pair (releasing what the Ownership
+// policy says the tree owns). The subtree is not touched, node storage is
+// owned by the tree's arena.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+::Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node::~Node() {
 
-    if constexpr (is_pointer_K && is_destructible_K) {
-        delete key;
+    if constexpr (owns_K) {
+        Ownership<K>::release(this->key);
     }
-    if constexpr (is_pointer_V && is_destructible_V) {
-        delete val;
+    if constexpr (owns_V) {
+        Ownership<V>::release(this->val);
     }
+}
 
-    // this will recursively delete all other nodes
-    // by calling deletion method on both sides.
-    delete left;
-    delete right;
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node::parent() const {
+    return reinterpret_cast<Node*>(parent_color & ~std::uintptr_t(1));
 }
 
-// to_string method:
-// ~ returns the representation (k,v), where k and v are the strings
-// ~ attributed to key and value (whatever they are)
-template<typename K, typename V>
-std::string Red_black_tree<K,V>::Node::to_string() {
-    return "(" + std::to_string(key) + "," + std::to_string(val) + ")";
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node::set_parent(Node* P) {
+    parent_color = reinterpret_cast<std::uintptr_t>(P) | (parent_color & 1);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+bool Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node::color() const {
+    return (parent_color & 1) != 0;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node::set_color(bool c) {
+    parent_color = (parent_color & ~std::uintptr_t(1)) | std::uintptr_t(c);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+std::uintptr_t Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node::pack(Node* P, bool c) {
+    static_assert(alignof(Node) >= 2, "the color bit needs a free bit in node addresses");
+    return reinterpret_cast<std::uintptr_t>(P) | std::uintptr_t(c);
+}
+
+// ITERATOR CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<bool Const>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::basic_iterator<Const>::basic_iterator(Node* n, const Red_black_tree* t) {
+    node = n;
+    tree = t;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<bool Const>
+template<bool C, typename>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::basic_iterator<Const>::basic_iterator(const basic_iterator<false>& other) {
+    node = other.node;
+    tree = other.tree;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<bool Const>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::template basic_iterator<Const>::reference
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::basic_iterator<Const>::operator*() const {
+    return *node;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<bool Const>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::template basic_iterator<Const>::pointer
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::basic_iterator<Const>::operator->() const {
+    return node;
+}
+
+// increment:
+// right subtree minimum, or the first ancestor reached from the left
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<bool Const>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::template basic_iterator<Const>&
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::basic_iterator<Const>::operator++() {
+    node = successor(node);
+    return *this;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<bool Const>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::template basic_iterator<Const>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::basic_iterator<Const>::operator++(int) {
+    basic_iterator old = *this;
+    node = successor(node);
+    return old;
+}
+
+// decrement:
+// from end() the maximum of the tree, otherwise the mirrored increment
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<bool Const>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::template basic_iterator<Const>&
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::basic_iterator<Const>::operator--() {
+    node = node == NIL ? tree->rightmost : predecessor(node);
+    return *this;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<bool Const>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::template basic_iterator<Const>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::basic_iterator<Const>::operator--(int) {
+    basic_iterator old = *this;
+    --*this;
+    return old;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<bool Const>
+bool Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::basic_iterator<Const>::operator==(const basic_iterator& other) const {
+    return node == other.node;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<bool Const>
+bool Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::basic_iterator<Const>::operator!=(const basic_iterator& other) const {
+    return node != other.node;
 }
 
 
 // RED BLACK TREE CODE! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-template<typename K, typename V>
-std::string Red_black_tree<K,V>::to_string(order print) {
-    if (print == INORDER) {
-        return inorder_print(root);
+// to_string method:
+// ~ the text write_to streams
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+std::string Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::to_string(order print) const {
+    std::ostringstream out;
+    write_to(out, print);
+    return out.str();
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::write_entry(std::ostream& out, const Node* N) {
+    if constexpr (std::is_same<V, No_value>::value) {
+        out << '(' << N->key << ')';
+    } else {
+        out << '(' << N->key << ',' << N->val << ')';
+    }
+}
+
+// write_to method:
+// every subtree prints as [left , entry , right] (INORDER), [entry left right]
+// (PREORDER) or [left right entry] (POSTORDER), an empty one as NIL.
+// The walk follows the parent links and remembers which side of N it is
+// done with, so it needs no stack at all.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::write_to(std::ostream& out, order print) const {
+    if (root == NIL) {
+        out << "NIL";
+        return;
     }
-    if (print == PREORDER) {
-        return preorder_print(root);
+
+    enum step { ENTER, LEFT_DONE, RIGHT_DONE };
+    Node* N = root;
+    step at = ENTER;
+    for (;;) {
+        if (at == ENTER) {
+            out << '[';
+            if (print == PREORDER) {
+                write_entry(out, N);
+            }
+            if (N->left != NIL) {
+                N = N->left;
+                continue;
+            }
+            out << "NIL";
+            at = LEFT_DONE;
+        }
+        if (at == LEFT_DONE) {
+            if (print == INORDER) {
+                out << ',';
+                write_entry(out, N);
+                out << ',';
+            }
+            if (N->right != NIL) {
+                N = N->right;
+                at = ENTER;
+                continue;
+            }
+            out << "NIL";
+        }
+        // both sides done
+        if (print == POSTORDER) {
+            write_entry(out, N);
+        }
+        out << ']';
+        Node* P = N->parent();
+        if (P == NIL) {
+            return;
+        }
+        at = N == P->left ? LEFT_DONE : RIGHT_DONE;
+        N = P;
     }
-    return postorder_print(root);
+}
 
+// freeze method:
+// Frozen_index copies the entries itself
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+Frozen_index<K, V, Compare> Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::freeze() const {
+    return Frozen_index<K, V, Compare>(*this);
 }
 
-template<typename K, typename V>
-std::string Red_black_tree<K,V>::inorder_print(Node* N) {
-    if (N == NIL) {
-        return "NIL";
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+Compare Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::key_comp() const {
+    if constexpr (Tree_stats::enabled) {
+        return comp.order;
+    } else {
+        return comp;
     }
-    return "[" + inorder_print(N->left) + "," + N->to_string() +"," + inorder_print(N->right) + "]";
 }
 
-template<typename K, typename V>
-std::string Red_black_tree<K,V>::preorder_print(Node* N) {
-    if (N == NIL) {
-        return "NIL";
+// write_snapshot method:
+// the header, padding up to the record alignment, then the entries by key order
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+bool Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::write_snapshot(std::ostream& out) const {
+    static_assert(snapshot_ready, "binary snapshots need trivially copyable, non pointer keys and values");
+    using Record = Snapshot_record<K, V>;
+
+    std::uint64_t count = 0;
+    if constexpr (Order_statistics) {
+        count = root->size;
+    } else {
+        for (Node* N = minNode(root); N != NIL; N = successor(N)) {
+            ++count;
+        }
     }
-    return "["+N->to_string() + preorder_print(N->left)+preorder_print(N->right)+"]";
-}
 
-template<typename K, typename V>
-std::string Red_black_tree<K,V>::postorder_print(Node* N) {
-    if (N == NIL) {
-        return "NIL";
+    Snapshot_header header{};
+    std::copy(Snapshot_header::signature, Snapshot_header::signature + 8, header.magic);
+    header.version = Snapshot_header::current_version;
+    header.byte_order = Snapshot_header::native_byte_order;
+    header.key_size = sizeof(K);
+    header.value_size = sizeof(V);
+    header.record_size = sizeof(Record);
+    header.count = count;
+    header.records_offset = (sizeof(Snapshot_header) + alignof(Record) - 1) / alignof(Record) * alignof(Record);
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof header);
+    for (std::size_t pad = sizeof header; pad < header.records_offset; ++pad) {
+        out.put('\0');
+    }
+    // records go out in blocks, one write() per record costs more than the copy.
+    // The buffer starts zeroed, so the padding between and after the fields
+    // goes out as zeros instead of whatever the stack held.
+    constexpr std::size_t block = 4096 / sizeof(Record) + 1;
+    Record buffer[block];
+    std::memset(static_cast<void*>(buffer), 0, sizeof buffer);
+    std::size_t used = 0;
+    for (Node* N = minNode(root); N != NIL; N = successor(N)) {
+        buffer[used].first = N->key;
+        buffer[used].second = N->val;
+        if (++used == block) {
+            out.write(reinterpret_cast<const char*>(buffer), sizeof(Record) * used);
+            used = 0;
+        }
     }
-    return "[" + postorder_print(N->left) + postorder_print(N->right) +  N->to_string() + "]";
+    out.write(reinterpret_cast<const char*>(buffer), sizeof(Record) * used);
+    return out.good();
 }
 
 
 // Initializer for the red black tree
 // makes the node immediately NIL
-template<typename K, typename V>
-Red_black_tree<K, V>::Red_black_tree() {
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Red_black_tree() : pool(std::make_unique<Node_arena<Node>>()) {
+    root = NIL;
+    leftmost = NIL;
+    rightmost = NIL;
+}
+
+// Initializer overload 1:
+// same as above, but node blocks come from the given resource
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Red_black_tree(std::pmr::memory_resource* resource)
+    : pool(std::make_unique<Node_arena<Node>>(resource)) {
+    root = NIL;
+    leftmost = NIL;
+    rightmost = NIL;
+}
+
+// Initializer overload 2:
+// with a comparator of its own
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Red_black_tree(const Compare& c, std::pmr::memory_resource* resource)
+    : pool(std::make_unique<Node_arena<Node>>(resource)), comp(c) {
     root = NIL;
+    leftmost = NIL;
+    rightmost = NIL;
 }
 
 // Deletion for the red black tree
-// recursively calls deletion on all nodes in the tree
-template<typename K, typename V>
-Red_black_tree<K, V>::~Red_black_tree() {
-    delete root;
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::~Red_black_tree() {
+    teardown();
 }
 
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Red_black_tree(const Red_black_tree& other)
+    : Red_black_tree(Clone_tag{}, other, 1) {}
 
-// find:
-// ~ the find operation retrieves the associated value to
-// ~ given key k (Implemented iteratively)
-template<typename K, typename V>
-V Red_black_tree<K, V>::find(K k) {
-    Node* n = root;
-    // while node isn't at the end of the tree
-    while (n != NIL) {
-        // otherwise, if key is smaller, then turn left way
-        if (k < n->key) {
-            n = n->left;
-        }
-        // otherwise turn right way
-        else if (k > n->key) {
-            n = n->right;
-        }else {
-            return n->val;
-        }
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>& Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::operator=(const Red_black_tree& other) {
+    if (this != &other) {
+        Red_black_tree copy(other);
+        swap(copy);
     }
-    // BUT THE POINTER SAFETY!!! (I am not sorry)
-    return NULL;
+    return *this;
 }
 
+// Move constructor:
+// other keeps no arena at all, Node_arena::resolve gives it a new one
+// when it needs one again
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Red_black_tree(Red_black_tree&& other) noexcept
+    : pool(std::move(other.pool)), comp(std::move(other.comp)) {
+    root = std::exchange(other.root, NIL);
+    leftmost = std::exchange(other.leftmost, NIL);
+    rightmost = std::exchange(other.rightmost, NIL);
+}
 
-// balancing subsection of the functions
-// all this section of codes starting here corresponds
-// to functions and utils that implement the balancing part
-// of the left right tree.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>& Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::operator=(Red_black_tree&& other) noexcept {
+    if (this != &other) {
+        teardown();
+        pool = std::move(other.pool);
+        comp = std::move(other.comp);
+        root = std::exchange(other.root, NIL);
+        leftmost = std::exchange(other.leftmost, NIL);
+        rightmost = std::exchange(other.rightmost, NIL);
+    }
+    return *this;
+}
 
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::swap(Red_black_tree& other) noexcept {
+    using std::swap;
+    swap(pool, other.pool);
+    swap(comp, other.comp);
+    swap(root, other.root);
+    swap(leftmost, other.leftmost);
+    swap(rightmost, other.rightmost);
+}
 
-// rotate_right:
-// makes a node rotation, interchanging
-// left node to the root
-template<typename K, typename V>
-typename Red_black_tree<K, V>::Node* Red_black_tree<K, V>::rotate_right(Node* N) {
-                            // assuming N as current root.
-    Node* w = N->left;       // hold left node
-    N->left = w->right;     // make current root's left, left node's right subtree
-    w->right = N;           // make held node's right our current root
-    return w;               // return held node as rooting tooting root
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::clear() {
+    teardown();
 }
 
-// rotate_left:
-// makes a node rotation, interchanging
-// right node to the root
-template<typename K, typename V>
-typename Red_black_tree<K, V>::Node* Red_black_tree<K, V>::rotate_left(Node* N) {
-    // inverse process as right is applied
-    Node* w = N->right;
-    N->right = w->left;
-    w->left = N;
-    return w;
+// teardown method:
+// node destructors only run when they have something to do, afterwards
+// the arena hands back all of its blocks at once. When other trees may
+// still hold nodes in the same blocks, only our slots are given back.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::teardown() {
+    if (!pool) {
+        // moved from, nothing to give back
+        return;
+    }
+    Node_arena<Node>& a = arena();
+    if (!a.shares_blocks()) {
+        if constexpr (!trivial_node_teardown) {
+            destroy_subtree(root);
+        }
+        a.release();
+    } else {
+        recycle_subtree(root, a);
+    }
+    root = NIL;
+    leftmost = NIL;
+    rightmost = NIL;
 }
 
-// flip_color:
-// if red make N black, else make N red
-template<typename K, typename V>
-void Red_black_tree<K, V>::flip_color(Node *N) {
-    N->color = !N->color;
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+Node_arena<typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node>& Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::arena() {
+    return Node_arena<Node>::resolve(pool);
 }
 
-// interchange_left_color:
-// left child exchange
-template<typename K, typename V>
-void Red_black_tree<K, V>::interchange_left_color(Node *N) {
-    bool c = N->color;
-    N->color = N->left->color;
-    N->left->color = c;
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+std::pmr::memory_resource* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::memory_resource() const {
+    return pool ? pool->resource() : std::pmr::get_default_resource();
 }
 
-// interchange_right_color:
-// right child exchange
-template<typename K, typename V>
-void Red_black_tree<K, V>::interchange_right_color(Node *N) {
-    bool c = N->color;
-    N->color = N->right->color;
-    N->right->color = c;
+// make_node method:
+// placement of a new node in arena storage
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename... Args>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::make_node(Args&&... args) {
+    return new (arena().allocate()) Node(std::forward<Args>(args)...);
 }
 
-// interchange_both_children_color:
-// left and right child exchange
-template<typename K, typename V>
-void Red_black_tree<K, V>::interchange_both_children_color(Node *N) {
-    bool c = N->color;
-    N->color = N->left->color;
-    N->left->color = c;
-    N->right->color = c;
+// recycle_subtree method:
+// same walk as destroy_subtree, every slot goes to the free list
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+std::size_t Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::recycle_subtree(Node* N, Node_arena<Node>& a) {
+    std::size_t count = 0;
+    dismantle(N, [&a, &count](Node* M) {
+        M->~Node();
+        a.recycle(M);
+        ++count;
+    });
+    return count;
 }
 
-// balance_insertion:
-// Taking N as a grandparent node, ensures invariance is kept.
-// 10 insertion balance cases, let the new node be N:
-//      1) No parent of N, therefore N is the root, nothing to do, root is automatically black by insertion call
-//      2) Parent is black, therefore the current insertion is balanced, nothing is to be done
-//      3) Parent is red left, uncle is red, grandparent is black, N is left
-//      4) Parent is red left, uncle is red, grandparent is black, N is right
-//              Cases 3,4 are analyzed from the grandparent. Which is flipped
-//              with parent and uncle to maintain balance. Then imbalance is solved upwards.
-//      5) Parent is red left, uncle is black (maybe NIL), N is left
-//      6) Parent is red left, uncle is black (maybe NIL), N is right
-//              Only one recolor operation is done upwards for 5,6, corresponding to N's insertion side
-//      7, 8, 9, 10) Parent is right for 3, 4, 5, and 6
-// balance method taken from my professor Dr. Kececioglu.
-// Not without studying them before. I promise Dr. K!
-template<typename K, typename V>
-typename Red_black_tree<K, V>::Node* Red_black_tree<K, V>::balance_insertion(Node *N, const K& k) {
-    // if grandparent color is black but not NIL
-    if (N->color == black && N != NIL) {
-       // cases 3,4,5,6: parent is left
-       if(k < N->key) {
-
-            Node* parent = N->left;
-
-            // if parent is red
-            if(parent->color == red) {
-                // and both second generation are red
-                if(N->right->color == red){
-                    // cases 3,4 if either child inserted is right or left and the correspondent
-                    // added node is red.
-                    if( (k < parent->key && parent->left->color == red) ||
-                        (k > parent->key && parent->right->color == red)) {
-                        // make parent and uncle black. Pass any red imbalance
-                        // to the grandparent.
-                        interchange_both_children_color(N);
-                    }
-                }
-                // case 5 is completed if uncle is black, k was added to the left
-                else if( k < parent->key && parent->left->color == red){
-                    // then we make parent black
-                    interchange_left_color(N);
-                    // and we rotate grandparent to the right
-                    N = rotate_right(N);
-                }
-                // case 6 is completed if uncle is black, k was added to the right
-                else if( k < parent->key && parent->right->color == red){
-                    // then we make parent black
-                    interchange_right_color(N);
-                    // and we rotate grandparent to the left
-                    N = rotate_left(N);
-                }
-            }
+// drop_node method:
+// the node never got linked, its slot is free again
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::drop_node(Node* N) {
+    N->~Node();
+    arena().recycle(N);
+}
 
-       }
-       // cases 7,8,9,10: parent is right
-       else {
-
-            Node* parent = N->right;
-            // all the rest are symmetric cases.
-            if(parent->color == red) {
-                if(N->left->color == red){
-                    if( (k < parent->key && parent->left->color == red)
-                     || (k > parent->key && parent->right->color == red)) {
-                        interchange_both_children_color(N);
-                     }
-                }
-                else if(k > parent->key && parent->right->color == red){
-                    interchange_right_color(N);
-                    N = rotate_left(N);
-                }
-                else if( k < parent->key && parent->left->color == red){
-                    // this is a way to mimic previous case balancing!
-                    N->right = rotate_right(N->right);
-                    interchange_right_color(N);
-                    N = rotate_left(N);
-                }
-            }
-       }
+// forget_node method:
+// the parts of the node are destroyed one by one, leaving out the
+// body of ~Node, which is what hands owned keys and values to release()
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::forget_node(Node* N) {
+    if constexpr (owns_K || owns_V) {
+        static_cast<Subtree_aggregate<Aggregate>*>(N)->~Subtree_aggregate();
+        static_cast<Entry*>(N)->~Entry();
+    } else {
+        N->~Node();
     }
-    return N;
+    arena().recycle(N);
 }
 
-template<typename K, typename V>
-typename Red_black_tree<K, V>::Node* Red_black_tree<K, V>::balance_removal(Node* P, Node* C) {
-    return NIL; // TODO (I am sleepy)
+// make_field method:
+// classes are direct-initialized from args, scalars (pointers above all)
+// only accept what converts implicitly
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename T, typename... Args>
+T Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::make_field(Args&&... args) {
+    if constexpr (std::is_class<T>::value || sizeof...(Args) != 1) {
+        return T(std::forward<Args>(args)...);
+    } else {
+        return (std::forward<Args>(args), ...);
+    }
 }
-// end of balancing subsection of the functions
 
+// destroy_subtree method:
+// calls the destructor of every node below N (N included)
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::destroy_subtree(Node* N) {
+    dismantle(N, [](Node* M) { M->~Node(); });
+}
 
-// ~~~~~~~~~~~~~~~ Insertion and deletion method of the function:
+// dismantle method:
+// while N has a left child, a right rotation lifts it above N; once it has
+// none, N is the least node left and goes, its right subtree is next.
+// A rotation moves one more node onto the right spine, where it stays,
+// so there are fewer than n of them.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Visit>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::dismantle(Node* N, Visit&& visit) {
+    while (N != NIL) {
+        Node* L = N->left;
+        if (L != NIL) {
+            N->left = L->right;
+            L->right = N;
+            N = L;
+        } else {
+            Node* next = N->right;
+            visit(N);
+            N = next;
+        }
+    }
+}
 
 
-// insert method:
-// The insert method creates a node from key K (type) k and value V (type) v
-// then proceeds to ensure tree balance.
-template<typename K, typename V>
-void Red_black_tree<K,V>::insert(const K& k, const V& v) {
-    root = insert(root, k, v);
-    root->color = black;
+// ~~~~~~~~~~~~~~~ Bulk loading from sorted input:
+
+
+// Initializer overload 2 (private):
+// backs from_sorted, so the result is returned without a copy
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename It>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Red_black_tree(Sorted_tag, It first, It last, unsigned threads)
+    : pool(std::make_unique<Node_arena<Node>>()) {
+    root = NIL;
+    leftmost = NIL;
+    rightmost = NIL;
+    assign_sorted(first, last, threads);
 }
 
-// insert method: (private overload)
-// Follows the typical insertion routine to a binary tree, then returns such result
-// as based on the balancing function.
-template<typename K, typename V>
-typename Red_black_tree<K, V>::Node* Red_black_tree<K, V>::insert(Node* N, const K& k, const V& v) {
-    if(N == NIL){
-        return new Node(k, v);
-    }
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename It>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate> Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::from_sorted(It first, It last, unsigned threads) {
+    return Red_black_tree(Sorted_tag{}, first, last, threads);
+}
 
-    if(N->key < k){
-        N->right = insert(N->right, k, v);
+// assign_sorted method:
+// all n nodes live in one array block. Linking picks the middle slot of
+// every range as its root, so subtree sizes differ by at most one and every
+// NIL link sits on one of two consecutive levels. Painting the deepest level
+// red (when it is not full) then gives every path the same black count.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename It>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::assign_sorted(It first, It last, unsigned threads) {
+    using category = typename std::iterator_traits<It>::iterator_category;
+    static_assert(std::is_base_of<std::forward_iterator_tag, category>::value,
+                  "assign_sorted needs to walk the input twice");
+
+    teardown();
+    std::size_t n = static_cast<std::size_t>(std::distance(first, last));
+    if (n == 0) {
+        return;
     }
-    else if (N->key > k){
-        N->left = insert(N->left, k, v);
+    Node* nodes = arena().allocate_array(n);
+
+    // depth of the deepest level, red unless n = 2^h - 1 fills it up
+    std::size_t deepest = 0;
+    while ((std::size_t(2) << deepest) <= n) {
+        ++deepest;
     }
-    else {
-        N->val = v;
-        return N;
+    std::size_t red_depth = ((n + 1) & n) == 0 ? std::numeric_limits<std::size_t>::max() : deepest;
+
+    constexpr bool parallel_input =
+        std::is_base_of<std::random_access_iterator_tag, category>::value
+        && std::is_nothrow_copy_constructible<K>::value && std::is_nothrow_copy_constructible<V>::value;
+
+    if constexpr (parallel_input) {
+        if (threads > 1 && n >= parallel_cutoff) {
+            // every subtree constructs its own slots
+            auto make = [&](std::size_t i) {
+                new (nodes + i) Node(first[i].first, first[i].second);
+            };
+            root = link_sorted(nodes, 0, n, 0, red_depth, NIL, threads, make);
+            leftmost = &nodes[0];
+            rightmost = &nodes[n - 1];
+            return;
+        }
     }
 
-    return balance_insertion(N, k);
+    // sequential construction, a throwing copy unwinds what was built
+    std::size_t built = 0;
+    try {
+        for (It it = first; it != last; ++it, ++built) {
+            new (nodes + built) Node(it->first, it->second);
+        }
+    } catch (...) {
+        for (std::size_t i = 0; i < n; ++i) {
+            if (i < built) {
+                nodes[i].~Node();
+            }
+            arena().recycle(nodes + i);
+        }
+        throw;
+    }
+    root = link_sorted(nodes, 0, n, 0, red_depth, NIL, threads, [](std::size_t) {});
+    leftmost = &nodes[0];
+    rightmost = &nodes[n - 1];
 }
 
-// remove method:
-// calls for removal of a node in the tree.
-template<typename K, typename V>
-void Red_black_tree<K, V>::remove(const K& k) {
-    // flag non defective tree by default
-    defective_tree = false;
-    // call the remove helper
-    root = remove(root, k);
-    // balance root black invariance
-    root->color = black;
-}
-
-// remove method: (private overload):
-// follows typical removal procedure of a node in a tree
-template<typename K, typename V>
-typename Red_black_tree<K, V>::Node* Red_black_tree<K, V>::remove(Node* N, const K& k) {
-    // if node is NIL return NIL
-    if (N == NIL) {
+// link_sorted method:
+// the left half goes to another thread while there are threads to spare
+// and the range is worth it, the right half stays on this one.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Make>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::link_sorted(Node* nodes, std::size_t lo, std::size_t hi,
+                                                                       std::size_t depth, std::size_t red_depth,
+                                                                       Node* parent, unsigned threads, const Make& make) {
+    if (lo == hi) {
         return NIL;
     }
-    // traverse, replace accordingly (right)
-    if (N->key < k) {
-        N->right = delete(N->right, k);
-        return balance_remove(N, N->right);
+    std::size_t mid = lo + (hi - lo) / 2;
+    make(mid);
+    Node* N = nodes + mid;
+    N->set_parent(parent);
+    N->set_color(depth == red_depth ? red : black);
+
+    if (threads > 1 && hi - lo >= parallel_cutoff) {
+        unsigned half = threads / 2;
+        auto left = std::async(std::launch::async, [=, &make] {
+            return link_sorted(nodes, lo, mid, depth + 1, red_depth, N, half, make);
+        });
+        N->right = link_sorted(nodes, mid + 1, hi, depth + 1, red_depth, N, threads - half, make);
+        N->left = left.get();
+    } else {
+        N->left = link_sorted(nodes, lo, mid, depth + 1, red_depth, N, 1, make);
+        N->right = link_sorted(nodes, mid + 1, hi, depth + 1, red_depth, N, 1, make);
     }
-    // traverse, replace accordingly (left)
-    if (N->key > k) {
-        N->left = delete(N->left, k);
-        return balance_remove(N, N->left);
+    pull(N);
+    return N;
+}
+
+
+// ~~~~~~~~~~~~~~~ Cloning:
+
+// Initializer overload 3 (private):
+// the copies sit in one array block in the preorder of other, so every
+// subtree is a run of slots with its root first and its left subtree right
+// after. Colors, sizes and aggregates are copied as they are: nothing is
+// compared, nothing rebalanced.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Red_black_tree(Clone_tag, const Red_black_tree& other, unsigned threads)
+    : pool(std::make_unique<Node_arena<Node>>(other.memory_resource())), comp(other.comp) {
+    static_assert(!owns_K && !owns_V, "copying a tree that owns its keys or values would release them twice");
+    root = NIL;
+    leftmost = NIL;
+    rightmost = NIL;
+    if (other.root == NIL) {
+        return;
     }
 
-    // Else case, key is equal and only right child exists
-    if (N->left == NIL) {
-        return remove_only_child_parent(N, N->right);
+    constexpr bool parallel_copies =
+        std::is_nothrow_copy_constructible<K>::value && std::is_nothrow_copy_constructible<V>::value;
+    // black height b means at least 2^b - 1 nodes: small trees are not
+    // worth a thread, not even for counting
+    std::size_t blacks = black_height(other.root);
+    if (!parallel_copies || blacks >= 64 || (std::size_t(1) << blacks) <= parallel_cutoff) {
+        threads = 1;
     }
+    std::size_t n = count_nodes(other.root, threads);
+    Node* nodes = arena().allocate_array(n);
 
-    // Else case, key is equal and only left child exists
-    if (N->right == NIL) {
-        return remove_only_child_parent(N, N->left);
+    if (threads > 1) {
+        root = clone_subtree(other.root, nodes, NIL, threads);
+    } else {
+        // nodes are built in slot order, a throwing copy unwinds what was built
+        Node* next = nodes;
+        try {
+            root = copy_subtree(other.root, NIL, next);
+        } catch (...) {
+            for (std::size_t i = 0; i < n; ++i) {
+                if (nodes + i < next) {
+                    nodes[i].~Node();
+                }
+                arena().recycle(nodes + i);
+            }
+            throw;
+        }
     }
+    leftmost = minNode(root);
+    rightmost = maxNode(root);
+}
 
-    // Else case, both children exist, such that we call a subcase
-    // that accounts for both.
-    N->right = remove_stressed_parent(N->right, N);
-    return balance_remove(N, N->right);
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate> Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::clone(unsigned threads) const {
+    return Red_black_tree(Clone_tag{}, *this, threads);
+}
 
+// count_nodes method:
+// recursion stays below 2 log2(n) deep in a red black tree, and reads every
+// node once (a successor walk reads most of them twice)
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+std::size_t Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::count_nodes(Node* N, unsigned threads) {
+    if constexpr (Order_statistics) {
+        return N->size;
+    }
+    if (N == NIL) {
+        return 0;
+    }
+    if (threads > 1) {
+        unsigned half = threads / 2;
+        auto left = std::async(std::launch::async, [=] { return count_nodes(N->left, half); });
+        std::size_t right = count_nodes(N->right, threads - half);
+        return left.get() + right + 1;
+    }
+    return count_nodes(N->left, 1) + count_nodes(N->right, 1) + 1;
 }
 
-// removes a node with at most one child
-template<typename K, typename V>
-typename Red_black_tree<K, V>::Node* Red_black_tree<K,V>::remove_only_child_parent(Node* P, Node* C) {
-    return NIL; // TODO (i am sleepy)
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::copy_subtree(Node* S, Node* parent, Node*& next) {
+    if (S == NIL) {
+        return NIL;
+    }
+    Node* C = new (next) Node(S->key, S->val, NIL, NIL, S->color());
+    ++next;
+    C->set_parent(parent);
+    if constexpr (Order_statistics) {
+        C->size = S->size;
+    }
+    if constexpr (has_aggregate) {
+        C->aggregate = S->aggregate;
+    }
+    C->left = copy_subtree(S->left, C, next);
+    C->right = copy_subtree(S->right, C, next);
+    return C;
 }
 
-// removes a node with both children
-template<typename K, typename V>
-typename Red_black_tree<K, V>::Node* Red_black_tree<K,V>::remove_stressed_parent(Node* P, Node* C) {
-    return NIL; // TODO (i am sleepy)
-}
\ No newline at end of file
+// clone_subtree method:
+// the right subtree starts after the left one, whose size has to be known
+// first; counting it costs a fraction of copying it, and is shared out
+// between the same threads
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::clone_subtree(Node* S, Node* slots, Node* parent, unsigned threads) {
+    if (threads < 2 || S == NIL) {
+        Node* next = slots;
+        return copy_subtree(S, parent, next);
+    }
+    Node* C = new (slots) Node(S->key, S->val, NIL, NIL, S->color());
+    C->set_parent(parent);
+    if constexpr (Order_statistics) {
+        C->size = S->size;
+    }
+    if constexpr (has_aggregate) {
+        C->aggregate = S->aggregate;
+    }
+
+    std::size_t left_count = count_nodes(S->left, threads);
+    unsigned half = threads / 2;
+    auto left = std::async(std::launch::async, [=] {
+        return clone_subtree(S->left, slots + 1, C, half);
+    });
+    C->right = clone_subtree(S->right, slots + 1 + left_count, C, threads - half);
+    C->left = left.get();
+    return C;
+}
+
+
+// find_node:
+// ~ the lookup behind find (Implemented iteratively)
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Q>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::find_node(const Q& k) const {
+    if constexpr (branchless_keys) {
+        // lower_bound, then one equality test: one comparison per level and
+        // both moves are mask selects (compilers turn a ternary back into a
+        // branch here), so random keys cost no mispredictions
+        auto pick = [](bool first, Node* a, Node* b) {
+            std::uintptr_t mask = std::uintptr_t(0) - std::uintptr_t(first);
+            return reinterpret_cast<Node*>((reinterpret_cast<std::uintptr_t>(a) & mask)
+                                           | (reinterpret_cast<std::uintptr_t>(b) & ~mask));
+        };
+        Node* n = root;
+        Node* bound = NIL;
+        while (n != NIL) {
+            bool right = comp(n->key, k);
+            bound = pick(right, bound, n);
+            n = pick(right, n->right, n->left);
+        }
+        return bound != NIL && !comp(k, bound->key) ? bound : NIL;
+    }
+    Node* n = root;
+    // while node isn't at the end of the tree
+    while (n != NIL) {
+        // otherwise, if key is smaller, then turn left way
+        if (comp(k, n->key)) {
+            n = n->left;
+        }
+        // otherwise turn right way
+        else if (comp(n->key, k)) {
+            n = n->right;
+        }else {
+            return n;
+        }
+    }
+    return NIL;
+}
+
+// find:
+// ~ the find operation retrieves the associated value to
+// ~ given key k. A miss is a nullptr, so any V works.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+V* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::find(const K& k) {
+    Node* n = find_node(k);
+    return n == NIL ? nullptr : &n->val;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+const V* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::find(const K& k) const {
+    Node* n = find_node(k);
+    return n == NIL ? nullptr : &n->val;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Q, typename C, typename>
+V* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::find(const Q& k) {
+    Node* n = find_node(k);
+    return n == NIL ? nullptr : &n->val;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Q, typename C, typename>
+const V* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::find(const Q& k) const {
+    Node* n = find_node(k);
+    return n == NIL ? nullptr : &n->val;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+bool Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::contains(const K& k) const {
+    return find_node(k) != NIL;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Q, typename C, typename>
+bool Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::contains(const Q& k) const {
+    return find_node(k) != NIL;
+}
+
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename It, typename Out>
+std::size_t Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::find_batch(It first, It last, Out out) {
+    std::size_t hits = 0;
+    find_nodes(first, last, [&](Node* n) {
+        hits += n != NIL;
+        *out++ = n == NIL ? nullptr : &n->val;
+    });
+    return hits;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename It, typename Out>
+std::size_t Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::find_batch(It first, It last, Out out) const {
+    std::size_t hits = 0;
+    find_nodes(first, last, [&](Node* n) {
+        hits += n != NIL;
+        *out++ = n == NIL ? nullptr : static_cast<const V*>(&n->val);
+    });
+    return hits;
+}
+
+// find_nodes method:
+// group prefetching. Every round moves each unfinished search of the
+// group one level down and prefetches the node it lands on; by the time
+// the round comes back to it, the line has (mostly) arrived. A group is
+// done when its deepest search is, then the results go out in key order.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename It, typename Emit>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::find_nodes(It first, It last, Emit&& emit) const {
+    static_assert(std::is_base_of<std::forward_iterator_tag,
+                                  typename std::iterator_traits<It>::iterator_category>::value,
+                  "find_batch reads every key once per level");
+
+    It key[find_width];
+    Node* at[find_width];
+    Node* hit[find_width];
+    while (first != last) {
+        std::size_t group = 0;
+        for (; group < find_width && first != last; ++group, ++first) {
+            key[group] = first;
+            at[group] = root;
+            hit[group] = NIL;
+        }
+
+        for (bool moving = root != NIL; moving;) {
+            moving = false;
+            for (std::size_t i = 0; i < group; ++i) {
+                Node* n = at[i];
+                if (n == NIL) {
+                    continue;
+                }
+                if (comp(*key[i], n->key)) {
+                    n = n->left;
+                } else if (comp(n->key, *key[i])) {
+                    n = n->right;
+                } else {
+                    hit[i] = n;
+                    n = NIL;
+                }
+                at[i] = n;
+                if (n != NIL) {
+                    prefetch(n);
+                    moving = true;
+                }
+            }
+        }
+
+        for (std::size_t i = 0; i < group; ++i) {
+            emit(hit[i]);
+        }
+    }
+}
+
+// prefetch:
+// the first and last byte of the node: the key opens it and the links
+// close it, and a node of up to a line that straddles two gets both.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::prefetch(const Node* N) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(N);
+    __builtin_prefetch(reinterpret_cast<const char*>(N + 1) - 1);
+#else
+    (void)N;
+#endif
+}
+
+// val_at_min, val_at_max, min_key, max_key:
+// read the cached extremes, NIL (built from K() and V()) when empty
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+V Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::val_at_min() const {
+    return leftmost->val;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+V Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::val_at_max() const {
+    return rightmost->val;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+K Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::min_key() const {
+    return leftmost->key;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+K Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::max_key() const {
+    return rightmost->key;
+}
+
+// minNode:
+// leftmost node below N
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::minNode(Node* N) {
+    if (N == NIL) {
+        return NIL;
+    }
+    while (N->left != NIL) {
+        N = N->left;
+    }
+    return N;
+}
+
+// maxNode:
+// rightmost node below N
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::maxNode(Node* N) {
+    if (N == NIL) {
+        return NIL;
+    }
+    while (N->right != NIL) {
+        N = N->right;
+    }
+    return N;
+}
+
+// successor:
+// minimum of the right subtree, otherwise climb until we
+// come up from a left child
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::successor(Node* N) {
+    if (N->right != NIL) {
+        return minNode(N->right);
+    }
+    Node* P = N->parent();
+    while (P != NIL && N == P->right) {
+        N = P;
+        P = P->parent();
+    }
+    return P;
+}
+
+// predecessor:
+// mirror of successor
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::predecessor(Node* N) {
+    if (N->left != NIL) {
+        return maxNode(N->left);
+    }
+    Node* P = N->parent();
+    while (P != NIL && N == P->left) {
+        N = P;
+        P = P->parent();
+    }
+    return P;
+}
+
+// lower_bound_node:
+// keeps the last node that was not less than k while descending
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Q>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::lower_bound_node(const Q& k) const {
+    Node* n = root;
+    Node* bound = NIL;
+    while (n != NIL) {
+        if (comp(n->key, k)) {
+            n = n->right;
+        } else {
+            bound = n;
+            n = n->left;
+        }
+    }
+    return bound;
+}
+
+// upper_bound_node:
+// keeps the last node that was greater than k while descending
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Q>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::upper_bound_node(const Q& k) const {
+    Node* n = root;
+    Node* bound = NIL;
+    while (n != NIL) {
+        if (comp(k, n->key)) {
+            bound = n;
+            n = n->left;
+        } else {
+            n = n->right;
+        }
+    }
+    return bound;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::begin() {
+    return iterator(leftmost, this);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::end() {
+    return iterator(NIL, this);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::const_iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::begin() const {
+    return const_iterator(leftmost, this);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::const_iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::end() const {
+    return const_iterator(NIL, this);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::const_iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::cbegin() const {
+    return begin();
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::const_iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::cend() const {
+    return end();
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::lower_bound(const K& k) {
+    return iterator(lower_bound_node(k), this);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::const_iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::lower_bound(const K& k) const {
+    return const_iterator(lower_bound_node(k), this);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Q, typename C, typename>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::lower_bound(const Q& k) {
+    return iterator(lower_bound_node(k), this);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Q, typename C, typename>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::const_iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::lower_bound(const Q& k) const {
+    return const_iterator(lower_bound_node(k), this);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Q, typename C, typename>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::upper_bound(const Q& k) {
+    return iterator(upper_bound_node(k), this);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Q, typename C, typename>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::const_iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::upper_bound(const Q& k) const {
+    return const_iterator(upper_bound_node(k), this);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::upper_bound(const K& k) {
+    return iterator(upper_bound_node(k), this);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::const_iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::upper_bound(const K& k) const {
+    return const_iterator(upper_bound_node(k), this);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+std::pair<typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator, typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::equal_range(const K& k) {
+    return {lower_bound(k), upper_bound(k)};
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+std::pair<typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::const_iterator, typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::const_iterator>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::equal_range(const K& k) const {
+    return {lower_bound(k), upper_bound(k)};
+}
+
+// previous:
+// the node just before lower_bound(k)
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::previous(const K& k) {
+    Node* n = lower_bound_node(k);
+    return iterator(n == NIL ? rightmost : predecessor(n), this);
+}
+
+// next:
+// exactly upper_bound(k)
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::next(const K& k) {
+    return upper_bound(k);
+}
+
+// for_each_in_range:
+// one descent to find lo, then successor steps until hi
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Fn>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::for_each_in_range(const K& lo, const K& hi, Fn&& fn) {
+    for (Node* n = lower_bound_node(lo); n != NIL && comp(n->key, hi); n = successor(n)) {
+        fn(n->key, n->val);
+    }
+}
+
+
+// balancing subsection of the functions
+// all this section of codes starting here corresponds
+// to functions and utils that implement the balancing part
+// of the left right tree.
+
+
+// pull method:
+// children first: NIL holds size 0 and the identity, so no branch is needed
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::pull(Node* N) {
+    if constexpr (Order_statistics) {
+        N->size = N->left->size + N->right->size + 1;
+    }
+    if constexpr (has_aggregate) {
+        N->aggregate = Aggregate::combine(Aggregate::combine(N->left->aggregate, Aggregate::lift(N->key, N->val)),
+                                          N->right->aggregate);
+    }
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::pull_path(Node* N) {
+    if constexpr (augmented) {
+        for (; N != NIL; N = N->parent()) {
+            pull(N);
+        }
+    }
+}
+
+// replace_child:
+// makes now take the place of old below P (top if P is NIL).
+// NIL is shared by every tree, so its fields are never written.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::replace_child(Node* P, Node* old, Node* now, Node*& top) {
+    if (P == NIL) {
+        top = now;
+    } else if (P->left == old) {
+        P->left = now;
+    } else {
+        P->right = now;
+    }
+    if (now != NIL) {
+        now->set_parent(P);
+    }
+}
+
+// rotate_right:
+// makes a node rotation, interchanging
+// left node to the root
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::rotate_right(Node* N, Node*& top) {
+    Tree_stats::count(right_rotations);
+                            // assuming N as current root.
+    Node* w = N->left;       // hold left node
+    N->left = w->right;     // make current root's left, left node's right subtree
+    if (w->right != NIL) {
+        w->right->set_parent(N);
+    }
+    replace_child(N->parent(), N, w, top);    // held node takes N's place upstairs
+    w->right = N;           // make held node's right our current root
+    N->set_parent(w);
+    pull(N);                // N is below w now, so it goes first
+    pull(w);
+    return w;               // return held node as rooting tooting root
+}
+
+// rotate_left:
+// makes a node rotation, interchanging
+// right node to the root
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::rotate_left(Node* N, Node*& top) {
+    Tree_stats::count(left_rotations);
+    // inverse process as right is applied
+    Node* w = N->right;
+    N->right = w->left;
+    if (w->left != NIL) {
+        w->left->set_parent(N);
+    }
+    replace_child(N->parent(), N, w, top);
+    w->left = N;
+    N->set_parent(w);
+    pull(N);
+    pull(w);
+    return w;
+}
+
+// flip_color:
+// if red make N black, else make N red
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::flip_color(Node *N) {
+    Tree_stats::count(recolors);
+    N->set_color(!N->color());
+}
+
+// interchange_left_color:
+// left child exchange
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::interchange_left_color(Node *N) {
+    Tree_stats::count(recolors);
+    bool c = N->color();
+    N->set_color(N->left->color());
+    N->left->set_color(c);
+}
+
+// interchange_right_color:
+// right child exchange
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::interchange_right_color(Node *N) {
+    Tree_stats::count(recolors);
+    bool c = N->color();
+    N->set_color(N->right->color());
+    N->right->set_color(c);
+}
+
+// interchange_both_children_color:
+// left and right child exchange
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::interchange_both_children_color(Node *N) {
+    Tree_stats::count(recolors);
+    bool c = N->color();
+    N->set_color(N->left->color());
+    N->left->set_color(c);
+    N->right->set_color(c);
+}
+
+// balance_insertion:
+// Taking N as the new red node, ensures invariance is kept.
+// 10 insertion balance cases, let the new node be N:
+//      1) No parent of N, therefore N is the root, nothing to do, root is automatically black by insertion call
+//      2) Parent is black, therefore the current insertion is balanced, nothing is to be done
+//      3) Parent is red left, uncle is red, grandparent is black, N is left
+//      4) Parent is red left, uncle is red, grandparent is black, N is right
+//              Cases 3,4 are analyzed from the grandparent. Which is flipped
+//              with parent and uncle to maintain balance. Then imbalance is solved upwards.
+//      5) Parent is red left, uncle is black (maybe NIL), N is left
+//      6) Parent is red left, uncle is black (maybe NIL), N is right
+//              Only one recolor operation is done upwards for 5,6, corresponding to N's insertion side
+//              (6 is first rotated into 5). The tree is balanced afterwards, so the loop stops.
+//      7, 8, 9, 10) Parent is right for 3, 4, 5, and 6
+// The walk goes up the parent links, no key is compared, and at most
+// two rotations are done per insertion.
+// balance method taken from my professor Dr. Kececioglu.
+// Not without studying them before. I promise Dr. K!
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+bool Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::balance_insertion(Node *N, Node*& top) {
+    // case 2 ends the loop, NIL (parent of the root) is black which covers case 1
+    for (;;) {
+        Node* parent = N->parent();
+        if (parent->color() == black) {
+            Tree_stats::count(parent == NIL ? insertion_case_1 : insertion_case_2);
+            break;
+        }
+        // a red parent is never the root, so the grandparent exists and is black
+        Node* grandparent = parent->parent();
+
+        // cases 3,4,5,6: parent is left
+        if (parent == grandparent->left) {
+            // cases 3,4: make parent and uncle black. Pass any red imbalance
+            // to the grandparent.
+            if (grandparent->right->color() == red) {
+                Tree_stats::count(N == parent->left ? insertion_case_3 : insertion_case_4);
+                interchange_both_children_color(grandparent);
+                N = grandparent;
+                continue;
+            }
+            // case 6: rotate the parent to fall in case 5
+            if (N == parent->right) {
+                Tree_stats::count(insertion_case_6);
+                rotate_left(parent, top);
+            } else {
+                Tree_stats::count(insertion_case_5);
+            }
+            // case 5: make parent black, grandparent red and rotate it to the right
+            interchange_left_color(grandparent);
+            rotate_right(grandparent, top);
+            break;
+        }
+
+        // cases 7,8,9,10: parent is right
+        // all the rest are symmetric cases.
+        if (grandparent->left->color() == red) {
+            Tree_stats::count(N == parent->left ? insertion_case_7 : insertion_case_8);
+            interchange_both_children_color(grandparent);
+            N = grandparent;
+            continue;
+        }
+        if (N == parent->left) {
+            Tree_stats::count(insertion_case_9);
+            // this is a way to mimic previous case balancing!
+            rotate_right(parent, top);
+        } else {
+            Tree_stats::count(insertion_case_10);
+        }
+        interchange_right_color(grandparent);
+        rotate_left(grandparent, top);
+        break;
+    }
+    bool grew = top->color() == red;
+    top->set_color(black);
+    return grew;
+}
+
+// balance_removal:
+// X carries an extra black. 4 removal balance cases, W the sibling of X:
+// 1. W is red: rotate it above P and recolor, W becomes a black sibling
+// 2. W and both its children are black: W turns red, the extra black moves
+//    up to P (the only case that loops, and it does not rotate)
+// 3. the far child of W is black, the near one red: rotate W, go to 4
+// 4. the far child of W is red: rotate P, recolor, done
+// so a removal rotates at most three times (1, 3, 4). A red X (or top)
+// just turns black. Written for X on the left, mirrored otherwise.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::balance_removal(Node* X, Node* P, Node*& top) {
+    while (X != top && X->color() == black) {
+        // X may be NIL: a NIL left link of P means X is on the left, since
+        // W below has at least one black node and cannot be NIL
+        bool left = P->left == X;
+        Node* W = left ? P->right : P->left;
+        if (W->color() == red) {
+            Tree_stats::count(removal_case_1);
+            W->set_color(black);
+            P->set_color(red);
+            if (left) {
+                rotate_left(P, top);
+            } else {
+                rotate_right(P, top);
+            }
+            W = left ? P->right : P->left;
+        }
+        Node* near = left ? W->left : W->right;
+        Node* far = left ? W->right : W->left;
+        if (near->color() == black && far->color() == black) {
+            Tree_stats::count(removal_case_2);
+            W->set_color(red);
+            X = P;
+            P = X->parent();
+            continue;
+        }
+        if (far->color() == black) {
+            Tree_stats::count(removal_case_3);
+            near->set_color(black);
+            W->set_color(red);
+            if (left) {
+                rotate_right(W, top);
+            } else {
+                rotate_left(W, top);
+            }
+            W = near;
+            far = left ? W->right : W->left;
+        }
+        Tree_stats::count(removal_case_4);
+        W->set_color(P->color());
+        P->set_color(black);
+        far->set_color(black);
+        if (left) {
+            rotate_left(P, top);
+        } else {
+            rotate_right(P, top);
+        }
+        X = top;
+        break;
+    }
+    if (X != NIL) {
+        X->set_color(black);
+    }
+}
+// end of balancing subsection of the functions
+
+
+// ~~~~~~~~~~~~~~~ Insertion and deletion method of the function:
+
+
+// descend method:
+// The descent is iterative and asks one question per level (k < key);
+// the last node where the answer was "no" is the only possible equal key,
+// so the equality check is a single extra comparison at the bottom.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Q>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::descend(const Q& k, Node*& parent, bool& left_side) const {
+    Node* candidate = NIL;
+    Node* n = root;
+    parent = NIL;
+    left_side = false;
+
+    while (n != NIL) {
+        parent = n;
+        left_side = comp(k, n->key);
+        if (left_side) {
+            n = n->left;
+        } else {
+            candidate = n;
+            n = n->right;
+        }
+    }
+
+    if (candidate != NIL && !comp(candidate->key, k)) {
+        return candidate;
+    }
+    return NIL;
+}
+
+// descend_from method:
+// keys before k were all looked up already, so the subtree of an ancestor
+// can hold k as long as k is below the key of the first ancestor that has
+// it on its left. Consecutive keys of a dense batch share all but the last
+// few levels of their paths, and those are the levels still in cache.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Q>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::descend_from(Node* finger, const Q& k, Node*& parent, bool& left_side, Node* top) const {
+    Node* n = top;
+    if (finger != NIL) {
+        n = finger;
+        for (Node* p = n->parent(); p != NIL; p = n->parent()) {
+            if (n == p->left && comp(k, p->key)) {
+                break;
+            }
+            n = p;
+        }
+    }
+
+    // from here on, the same descent as descend
+    Node* candidate = NIL;
+    parent = NIL;
+    left_side = false;
+    while (n != NIL) {
+        parent = n;
+        left_side = comp(k, n->key);
+        if (left_side) {
+            n = n->left;
+        } else {
+            candidate = n;
+            n = n->right;
+        }
+    }
+
+    if (candidate != NIL && !comp(candidate->key, k)) {
+        return candidate;
+    }
+    return NIL;
+}
+
+// locate method:
+// equal keys are not appended: k has to be strictly above the greatest
+// (below the least)
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Q>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::locate(const Q& k, Node*& parent, bool& left_side) const {
+    if (rightmost != NIL && comp(rightmost->key, k)) {
+        parent = rightmost;
+        left_side = false;
+        return NIL;
+    }
+    if (leftmost != NIL && comp(k, leftmost->key)) {
+        parent = leftmost;
+        left_side = true;
+        return NIL;
+    }
+    return descend(k, parent, left_side);
+}
+
+// locate_near method:
+// end() climbs the right spine from rightmost while k is below the parent,
+// then descends: the spine node stopped under holds the greatest key not
+// above k, so only its right subtree (where we are) is left to search.
+// A node hint checks k against it and its predecessor, and searches up
+// from it (descend_from) when k comes after it.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Q>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::locate_near(Node* hint, const Q& k, Node*& parent, bool& left_side) const {
+    if (hint == NIL) {
+        Node* n = rightmost;
+        if (n == NIL || comp(n->key, k)) {
+            parent = n;
+            left_side = false;
+            return NIL;
+        }
+        for (Node* p = n->parent(); p != NIL && comp(k, p->key); p = n->parent()) {
+            n = p;
+        }
+        Node* below = n->parent();
+        if (below != NIL && !comp(below->key, k)) {
+            return below;
+        }
+        return descend_from(NIL, k, parent, left_side, n);
+    }
+
+    if (comp(k, hint->key)) {
+        Node* before = predecessor(hint);
+        if (before == NIL || comp(before->key, k)) {
+            // k goes between the two, one of them has the free link
+            if (hint->left == NIL) {
+                parent = hint;
+                left_side = true;
+            } else {
+                parent = before;
+                left_side = false;
+            }
+            return NIL;
+        }
+        return descend(k, parent, left_side);
+    }
+    if (!comp(hint->key, k)) {
+        return hint;
+    }
+    return descend_from(hint, k, parent, left_side, root);
+}
+
+// link_node method:
+// the new node takes the NIL spot found by descend
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::link_node(Node* N, Node* parent, bool left_side) {
+    // rotations never change which nodes are the extremes, only this can
+    if (parent == NIL) {
+        leftmost = N;
+        rightmost = N;
+    } else if (parent == leftmost && left_side) {
+        leftmost = N;
+    } else if (parent == rightmost && !left_side) {
+        rightmost = N;
+    }
+    link_below(N, parent, left_side, root);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+bool Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::link_below(Node* N, Node* parent, bool left_side, Node*& top) {
+    N->set_parent(parent);
+    if (parent == NIL) {
+        top = N;
+    } else if (left_side) {
+        parent->left = N;
+    } else {
+        parent->right = N;
+    }
+    pull(N);
+    pull_path(parent);
+    return balance_insertion(N, top);
+}
+
+// insert method:
+// The insert method creates a node from key K (type) k and value V (type) v
+// then proceeds to ensure tree balance.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::insert(const K& k, const V& v) {
+    insert_or_assign(k, v);
+}
+
+// insert method: (rvalue overload)
+// k and v are moved straight into the node
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::insert(K&& k, V&& v) {
+    insert_or_assign(std::move(k), std::move(v));
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename VV, typename>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::insert(const K& k) {
+    try_emplace_key(k);
+}
+
+// assign_found method:
+// the old value is kept aside until the new one is in, a throwing
+// assignment then leaves the entry as it was
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename VV>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::assign_found(Node* found, const K& k, VV&& v) {
+    if constexpr (owns_V) {
+        V old = found->val;
+        found->val = std::forward<VV>(v);
+        if (!(old == found->val)) {
+            Ownership<V>::release(old);
+        }
+    } else {
+        found->val = std::forward<VV>(v);
+    }
+    if constexpr (owns_K) {
+        if (!(k == found->key)) {
+            Ownership<K>::release(k);
+        }
+    }
+    pull_path(found);
+}
+
+// insert_or_assign method:
+// key is already there, only the value is replaced
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename KK, typename VV>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::insert_or_assign(KK&& k, VV&& v) {
+    Node* parent;
+    bool left_side;
+    Node* found = locate(k, parent, left_side);
+    if (found != NIL) {
+        assign_found(found, k, std::forward<VV>(v));
+        return;
+    }
+    link_node(make_node(std::in_place, std::forward<KK>(k), std::forward<VV>(v)), parent, left_side);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::insert(const_iterator hint, const K& k, const V& v) {
+    return insert_hinted(hint.node, k, v);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::insert(const_iterator hint, K&& k, V&& v) {
+    return insert_hinted(hint.node, std::move(k), std::move(v));
+}
+
+// insert_hinted method:
+// insert_or_assign, located from the hint
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename KK, typename VV>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::insert_hinted(Node* hint, KK&& k, VV&& v) {
+    Node* parent;
+    bool left_side;
+    Node* found = locate_near(hint, k, parent, left_side);
+    if (found != NIL) {
+        assign_found(found, k, std::forward<VV>(v));
+        return iterator(found, this);
+    }
+    Node* N = make_node(std::in_place, std::forward<KK>(k), std::forward<VV>(v));
+    link_node(N, parent, left_side);
+    return iterator(N, this);
+}
+
+// emplace method:
+// the node is built first, its own key drives the descent
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename KK, typename... Args>
+std::pair<typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator, bool>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::emplace(KK&& k, Args&&... args) {
+    Node* N = make_node(std::in_place, std::forward<KK>(k), std::forward<Args>(args)...);
+    Node* parent;
+    bool left_side;
+    Node* found = locate(N->key, parent, left_side);
+    if (found != NIL) {
+        drop_node(N);
+        return {iterator(found, this), false};
+    }
+    link_node(N, parent, left_side);
+    return {iterator(N, this), true};
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename KK, typename... Args>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::emplace_hint(const_iterator hint, KK&& k, Args&&... args) {
+    Node* N = make_node(std::in_place, std::forward<KK>(k), std::forward<Args>(args)...);
+    Node* parent;
+    bool left_side;
+    Node* found = locate_near(hint.node, N->key, parent, left_side);
+    if (found != NIL) {
+        drop_node(N);
+        return iterator(found, this);
+    }
+    link_node(N, parent, left_side);
+    return iterator(N, this);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename... Args>
+std::pair<typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator, bool>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::try_emplace(const K& k, Args&&... args) {
+    return try_emplace_key(k, std::forward<Args>(args)...);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename... Args>
+std::pair<typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator, bool>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::try_emplace(K&& k, Args&&... args) {
+    return try_emplace_key(std::move(k), std::forward<Args>(args)...);
+}
+
+// try_emplace_key method:
+// the descent comes first, the node is only built for a new key
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename KK, typename... Args>
+std::pair<typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator, bool>
+Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::try_emplace_key(KK&& k, Args&&... args) {
+    Node* parent;
+    bool left_side;
+    Node* found = locate(k, parent, left_side);
+    if (found != NIL) {
+        return {iterator(found, this), false};
+    }
+    Node* N = make_node(std::in_place, std::forward<KK>(k), std::forward<Args>(args)...);
+    link_node(N, parent, left_side);
+    return {iterator(N, this), true};
+}
+
+// insert_batch method:
+// the batch is copied, sorted and rid of duplicates (the last one of equal
+// keys stays, owned ones dropped are released) before any node is touched. Parts filled by other threads take
+// their nodes from arenas of their own, merged into ours afterwards.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename It>
+std::size_t Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::insert_batch(It first, It last, unsigned threads) {
+    std::vector<std::pair<K, V>> batch;
+    for (; first != last; ++first) {
+        batch.emplace_back(first->first, first->second);
+    }
+    std::stable_sort(batch.begin(), batch.end(), [this](const std::pair<K, V>& a, const std::pair<K, V>& b) {
+        return comp(a.first, b.first);
+    });
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        if (i + 1 < batch.size() && !comp(batch[i].first, batch[i + 1].first)) {
+            if constexpr (owns_K || owns_V) {
+                release_dropped(batch, i);
+            }
+            continue;
+        }
+        if (kept != i) {
+            batch[kept] = std::move(batch[i]);
+        }
+        ++kept;
+    }
+    batch.erase(batch.begin() + kept, batch.end());
+
+    std::size_t added = 0;
+    constexpr bool parallel_entries =
+        std::is_nothrow_move_constructible<K>::value && std::is_nothrow_move_constructible<V>::value;
+    std::size_t parts = std::min<std::size_t>(threads, batch.size() / parallel_cutoff);
+    if (!parallel_entries || parts < 2) {
+        try {
+            insert_run(root, batch.begin(), batch.end(), arena(), added);
+        } catch (...) {
+            leftmost = minNode(root);
+            rightmost = maxNode(root);
+            throw;
+        }
+        leftmost = minNode(root);
+        rightmost = maxNode(root);
+        return added;
+    }
+
+    // part j gets the keys from cut[j] on, and the tree is split right before
+    // each of those keys, from the greatest one down
+    std::vector<std::size_t> cut(parts + 1);
+    for (std::size_t j = 0; j <= parts; ++j) {
+        cut[j] = batch.size() * j / parts;
+    }
+    std::vector<Piece> pieces(parts);
+    Piece rest = piece_of();
+    for (std::size_t j = parts - 1; j > 0; --j) {
+        Piece lesser, greater;
+        Node* found = split(rest, batch[cut[j]].first, lesser, greater, comp);
+        if (found != NIL) {
+            greater = join(Piece{NIL, 0}, found, greater);
+        }
+        pieces[j] = greater;
+        rest = lesser;
+    }
+    pieces[0] = rest;
+
+    std::vector<std::unique_ptr<Node_arena<Node>>> arenas(parts);
+    std::vector<std::size_t> added_by(parts, 0);
+    auto fill = [&](std::size_t j) {
+        make_standalone(pieces[j]);
+        Node_arena<Node>& a = j == 0 ? arena() : *arenas[j];
+        pieces[j].black_height += insert_run(pieces[j].top, batch.begin() + cut[j], batch.begin() + cut[j + 1], a, added_by[j]);
+    };
+
+    // the parts are joined back even when one of them failed to allocate
+    std::exception_ptr failure;
+    {
+        std::vector<std::future<void>> running;
+        for (std::size_t j = 1; j < parts; ++j) {
+            arenas[j] = std::make_unique<Node_arena<Node>>(arena().resource());
+            running.push_back(std::async(std::launch::async, fill, j));
+        }
+        try {
+            fill(0);
+        } catch (...) {
+            failure = std::current_exception();
+        }
+        for (std::future<void>& r : running) {
+            try {
+                r.get();
+            } catch (...) {
+                failure = std::current_exception();
+            }
+        }
+    }
+
+    Piece whole = pieces[0];
+    for (std::size_t j = 1; j < parts; ++j) {
+        arena().adopt(*arenas[j]);
+        whole = join_pieces(whole, pieces[j]);
+    }
+    adopt_piece(whole);
+    for (std::size_t n : added_by) {
+        added += n;
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+    return added;
+}
+
+// release_dropped method:
+// batch[i] is dropped for a later pair of equal key. What it owns is
+// released unless the entry of that key in the tree or a later pair of the
+// run holds the same key or value, which then gets released (or kept) in
+// its turn.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::release_dropped(std::vector<std::pair<K, V>>& batch, std::size_t i) const {
+    const Node* stored = find_node(batch[i].first);
+    bool key_later = false;
+    bool val_later = false;
+    if (stored != NIL) {
+        if constexpr (owns_K) {
+            key_later = batch[i].first == stored->key;
+        }
+        if constexpr (owns_V) {
+            val_later = batch[i].second == stored->val;
+        }
+    }
+    for (std::size_t j = i + 1; j < batch.size() && !comp(batch[i].first, batch[j].first); ++j) {
+        if constexpr (owns_K) {
+            key_later = key_later || batch[i].first == batch[j].first;
+        }
+        if constexpr (owns_V) {
+            val_later = val_later || batch[i].second == batch[j].second;
+        }
+    }
+    if constexpr (owns_K) {
+        if (!key_later) {
+            Ownership<K>::release(batch[i].first);
+        }
+    }
+    if constexpr (owns_V) {
+        if (!val_later) {
+            Ownership<V>::release(batch[i].second);
+        }
+    }
+}
+
+// insert_run method:
+// the finger is the node of the previous key, rotations may move it but it
+// stays in the tree, which is all descend_from needs
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename It>
+std::size_t Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::insert_run(Node*& top, It first, It last, Node_arena<Node>& a, std::size_t& added) const {
+    std::size_t grew = 0;
+    Node* finger = NIL;
+    for (; first != last; ++first) {
+        Node* parent;
+        bool left_side;
+        Node* found = descend_from(finger, first->first, parent, left_side, top);
+        if (found != NIL) {
+            assign_found(found, first->first, std::move(first->second));
+            finger = found;
+            continue;
+        }
+        Node* N = new (a.allocate()) Node(std::in_place, std::move(first->first), std::move(first->second));
+        if (link_below(N, parent, left_side, top)) {
+            ++grew;
+        }
+        ++added;
+        finger = N;
+    }
+    return grew;
+}
+
+// remove method:
+// descend finds the node, erase_node does the rest
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+bool Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::remove(const K& k) {
+    Node* parent;
+    bool left_side;
+    Node* found = descend(k, parent, left_side);
+    if (found == NIL) {
+        return false;
+    }
+    erase_node(found);
+    return true;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::erase(const_iterator pos) {
+    Node* next = successor(pos.node);
+    erase_node(pos.node);
+    return iterator(next, this);
+}
+
+// pop_min method:
+// the least node has no left child, so unlink never swaps it with its
+// successor and the value can be moved out before it goes
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+std::optional<std::pair<K, V>> Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::pop_min() {
+    if (leftmost == NIL) {
+        return std::nullopt;
+    }
+    Node* N = leftmost;
+    std::optional<std::pair<K, V>> entry(std::in_place, N->key, std::move(N->val));
+    detach_node(N);
+    forget_node(N);
+    return entry;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+std::optional<std::pair<K, V>> Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::pop_max() {
+    if (rightmost == NIL) {
+        return std::nullopt;
+    }
+    Node* N = rightmost;
+    std::optional<std::pair<K, V>> entry(std::in_place, N->key, std::move(N->val));
+    detach_node(N);
+    forget_node(N);
+    return entry;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::detach_node(Node* N) {
+    if (N == leftmost) {
+        leftmost = successor(N);
+    }
+    if (N == rightmost) {
+        rightmost = predecessor(N);
+    }
+    unlink(N, root);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::erase_node(Node* N) {
+    detach_node(N);
+    drop_node(N);
+}
+
+// unlink method:
+// a node with two children trades places with its successor S (the
+// minimum of its right subtree, which has no left child), so the node
+// actually cut out of the tree always has at most one child X. The color
+// that disappears is the one of that cut node, S taking over the color of N.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::unlink(Node* N, Node*& top) {
+    Node* X;
+    Node* P;
+    bool lost;
+    if (N->left == NIL || N->right == NIL) {
+        X = N->left != NIL ? N->left : N->right;
+        P = N->parent();
+        lost = N->color();
+        replace_child(P, N, X, top);
+    } else {
+        Node* S = minNode(N->right);
+        X = S->right;
+        lost = S->color();
+        if (S->parent() == N) {
+            P = S;
+        } else {
+            P = S->parent();
+            replace_child(P, S, X, top);
+            S->right = N->right;
+            S->right->set_parent(S);
+        }
+        replace_child(N->parent(), N, S, top);
+        S->left = N->left;
+        S->left->set_parent(S);
+        S->set_color(N->color());
+    }
+    // P is the deepest node whose subtree changed, S (if any) is above it
+    pull_path(P);
+    if (lost == black) {
+        balance_removal(X, P, top);
+    }
+}
+
+// ~~~~~~~~~~~~~~~ Join, split and set algebra:
+
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Graveyard::bury(Node* N) {
+    if (N == NIL) {
+        return;
+    }
+    N->set_parent(NIL);
+    if (head == NIL) {
+        head = N;
+    } else {
+        tail->set_parent(N);
+    }
+    tail = N;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Graveyard::bury_node(Node* N) {
+    N->left = NIL;
+    N->right = NIL;
+    bury(N);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Graveyard::append(Graveyard& other) {
+    if (other.head == NIL) {
+        return;
+    }
+    if (head == NIL) {
+        head = other.head;
+    } else {
+        tail->set_parent(other.head);
+    }
+    tail = other.tail;
+    other.head = NIL;
+    other.tail = NIL;
+}
+
+// black_height:
+// any path works, every one of them has the same black count
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+std::size_t Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::black_height(Node* N) {
+    std::size_t h = 0;
+    for (; N != NIL; N = N->left) {
+        if (N->color() == black) {
+            ++h;
+        }
+    }
+    return h;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Piece Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::piece_of() const {
+    return Piece{root, black_height(root)};
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::adopt_piece(Piece P) {
+    root = P.top;
+    if (root != NIL) {
+        root->set_parent(NIL);
+        root->set_color(black);
+    }
+    leftmost = minNode(root);
+    rightmost = maxNode(root);
+}
+
+// make_standalone method:
+// a red top is blackened, which adds one to the black height
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::make_standalone(Piece& P) {
+    if (P.top == NIL) {
+        return;
+    }
+    P.top->set_parent(NIL);
+    if (P.top->color() == red) {
+        P.top->set_color(black);
+        ++P.black_height;
+    }
+}
+
+// join method: (private overload)
+// both sides are first made standalone trees (parentless, black top), then
+// if their black heights match x simply becomes the new black root.
+// Otherwise x is hung red in the taller tree and balance_insertion
+// deals with a possible red parent. O(|bh(L) - bh(R)| + 1).
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Piece Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::join(Piece L, Node* x, Piece R) {
+    make_standalone(L);
+    make_standalone(R);
+
+    if (L.black_height == R.black_height) {
+        x->left = L.top;
+        x->right = R.top;
+        x->set_parent(NIL);
+        x->set_color(black);
+        if (L.top != NIL) {
+            L.top->set_parent(x);
+        }
+        if (R.top != NIL) {
+            R.top->set_parent(x);
+        }
+        pull(x);
+        return Piece{x, L.black_height + 1};
+    }
+
+    bool left_taller = L.black_height > R.black_height;
+    Piece& tall = left_taller ? L : R;
+    Piece& low = left_taller ? R : L;
+
+    // down the inner spine of the taller tree, up to a black node of equal black height
+    Node* parent = NIL;
+    Node* y = tall.top;
+    std::size_t h = tall.black_height;
+    while (y->color() == red || h > low.black_height) {
+        if (y->color() == black) {
+            --h;
+        }
+        parent = y;
+        y = left_taller ? y->right : y->left;
+    }
+
+    x->left = left_taller ? y : low.top;
+    x->right = left_taller ? low.top : y;
+    x->set_parent(parent);
+    x->set_color(red);
+    if (y != NIL) {
+        y->set_parent(x);
+    }
+    if (low.top != NIL) {
+        low.top->set_parent(x);
+    }
+    if (left_taller) {
+        parent->right = x;
+    } else {
+        parent->left = x;
+    }
+    // the nodes above x are the spine just walked, so this stays O(|bh(L) - bh(R)| + 1)
+    pull(x);
+    pull_path(parent);
+
+    Node* top = tall.top;
+    bool grew = balance_insertion(x, top);
+    return Piece{top, tall.black_height + (grew ? 1 : 0)};
+}
+
+// join_pieces method:
+// nothing to hang in the middle, so the maximum of L is borrowed
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Piece Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::join_pieces(Piece L, Piece R) {
+    if (L.top == NIL) {
+        return R;
+    }
+    if (R.top == NIL) {
+        return L;
+    }
+    Node* last = NIL;
+    Piece rest = split_last(L, last);
+    return join(rest, last, R);
+}
+
+// split_last method:
+// follows the right spine, joining every left subtree back on the way up
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Piece Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::split_last(Piece T, Node*& last) {
+    Node* N = T.top;
+    std::size_t child_height = T.black_height - (N->color() == black ? 1 : 0);
+    if (N->right == NIL) {
+        last = N;
+        return Piece{N->left, child_height};
+    }
+    Piece rest = split_last(Piece{N->right, child_height}, last);
+    return join(Piece{N->left, child_height}, N, rest);
+}
+
+// split method: (private overload)
+// descends towards k; every node passed on the way is joined, together with
+// the subtree hanging on the other side, to the half it belongs to.
+// The joins telescope over black heights, so the whole split is O(log n).
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::split(Piece T, const K& k, Piece& lesser, Piece& greater, const Key_order& comp) {
+    Node* N = T.top;
+    if (N == NIL) {
+        lesser = Piece{NIL, 0};
+        greater = Piece{NIL, 0};
+        return NIL;
+    }
+    std::size_t child_height = T.black_height - (N->color() == black ? 1 : 0);
+    Piece left{N->left, child_height};
+    Piece right{N->right, child_height};
+
+    if (comp(k, N->key)) {
+        Piece part;
+        Node* found = split(left, k, lesser, part, comp);
+        greater = join(part, N, right);
+        return found;
+    }
+    if (comp(N->key, k)) {
+        Piece part;
+        Node* found = split(right, k, part, greater, comp);
+        lesser = join(left, N, part);
+        return found;
+    }
+    lesser = left;
+    greater = right;
+    N->left = NIL;
+    N->right = NIL;
+    pull(N);
+    return N;
+}
+
+// union_pieces method:
+// the root of A splits B, a duplicate in B is dropped
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Piece Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::union_pieces(Piece A, Piece B, unsigned threads, Graveyard& grave, const Key_order& comp) {
+    if (A.top == NIL) {
+        return B;
+    }
+    if (B.top == NIL) {
+        return A;
+    }
+    Node* a = A.top;
+    std::size_t child_height = A.black_height - (a->color() == black ? 1 : 0);
+    Piece A_lesser{a->left, child_height};
+    Piece A_greater{a->right, child_height};
+    Piece B_lesser, B_greater;
+    Node* duplicate = split(B, a->key, B_lesser, B_greater, comp);
+    if (duplicate != NIL) {
+        grave.bury_node(duplicate);
+    }
+
+    Piece lesser, greater;
+    if (threads > 1 && A.black_height >= fork_black_height) {
+        unsigned half = threads / 2;
+        Graveyard forked;
+        auto left = std::async(std::launch::async, [&] {
+            return union_pieces(A_lesser, B_lesser, half, forked, comp);
+        });
+        greater = union_pieces(A_greater, B_greater, threads - half, grave, comp);
+        lesser = left.get();
+        grave.append(forked);
+    } else {
+        lesser = union_pieces(A_lesser, B_lesser, 1, grave, comp);
+        greater = union_pieces(A_greater, B_greater, 1, grave, comp);
+    }
+    return join(lesser, a, greater);
+}
+
+// intersect_pieces method:
+// the root of A survives only if B had the same key
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Piece Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::intersect_pieces(Piece A, Piece B, unsigned threads, Graveyard& grave, const Key_order& comp) {
+    if (A.top == NIL || B.top == NIL) {
+        grave.bury(A.top);
+        grave.bury(B.top);
+        return Piece{NIL, 0};
+    }
+    Node* a = A.top;
+    std::size_t child_height = A.black_height - (a->color() == black ? 1 : 0);
+    Piece A_lesser{a->left, child_height};
+    Piece A_greater{a->right, child_height};
+    Piece B_lesser, B_greater;
+    Node* duplicate = split(B, a->key, B_lesser, B_greater, comp);
+
+    Piece lesser, greater;
+    if (threads > 1 && A.black_height >= fork_black_height) {
+        unsigned half = threads / 2;
+        Graveyard forked;
+        auto left = std::async(std::launch::async, [&] {
+            return intersect_pieces(A_lesser, B_lesser, half, forked, comp);
+        });
+        greater = intersect_pieces(A_greater, B_greater, threads - half, grave, comp);
+        lesser = left.get();
+        grave.append(forked);
+    } else {
+        lesser = intersect_pieces(A_lesser, B_lesser, 1, grave, comp);
+        greater = intersect_pieces(A_greater, B_greater, 1, grave, comp);
+    }
+
+    if (duplicate != NIL) {
+        grave.bury_node(duplicate);
+        return join(lesser, a, greater);
+    }
+    grave.bury_node(a);
+    return join_pieces(lesser, greater);
+}
+
+// difference_pieces method:
+// the root of B splits A, both that root and its match in A are dropped
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Piece Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::difference_pieces(Piece A, Piece B, unsigned threads, Graveyard& grave, const Key_order& comp) {
+    if (A.top == NIL || B.top == NIL) {
+        grave.bury(B.top);
+        return A;
+    }
+    Node* b = B.top;
+    std::size_t child_height = B.black_height - (b->color() == black ? 1 : 0);
+    Piece B_lesser{b->left, child_height};
+    Piece B_greater{b->right, child_height};
+    Piece A_lesser, A_greater;
+    Node* duplicate = split(A, b->key, A_lesser, A_greater, comp);
+
+    Piece lesser, greater;
+    if (threads > 1 && B.black_height >= fork_black_height) {
+        unsigned half = threads / 2;
+        Graveyard forked;
+        auto left = std::async(std::launch::async, [&] {
+            return difference_pieces(A_lesser, B_lesser, half, forked, comp);
+        });
+        greater = difference_pieces(A_greater, B_greater, threads - half, grave, comp);
+        lesser = left.get();
+        grave.append(forked);
+    } else {
+        lesser = difference_pieces(A_lesser, B_lesser, 1, grave, comp);
+        greater = difference_pieces(A_greater, B_greater, 1, grave, comp);
+    }
+
+    grave.bury_node(b);
+    if (duplicate != NIL) {
+        grave.bury_node(duplicate);
+    }
+    return join_pieces(lesser, greater);
+}
+
+// erase_pieces method:
+// the middle key splits A, its node (if any) is dropped and both halves
+// go on with the keys on their side
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Piece Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::erase_pieces(Piece A, const K* lo, const K* hi, unsigned threads, Graveyard& grave,
+                                                                                                  const Key_order& comp, std::size_t& removed) {
+    if (A.top == NIL || lo == hi) {
+        return A;
+    }
+    const K* mid = lo + (hi - lo) / 2;
+    Piece A_lesser, A_greater;
+    Node* found = split(A, *mid, A_lesser, A_greater, comp);
+
+    Piece lesser, greater;
+    if (threads > 1 && A.black_height >= fork_black_height && hi - lo >= 2) {
+        unsigned half = threads / 2;
+        Graveyard forked;
+        std::size_t removed_left = 0;
+        auto left = std::async(std::launch::async, [&] {
+            return erase_pieces(A_lesser, lo, mid, half, forked, comp, removed_left);
+        });
+        greater = erase_pieces(A_greater, mid + 1, hi, threads - half, grave, comp, removed);
+        lesser = left.get();
+        grave.append(forked);
+        removed += removed_left;
+    } else {
+        lesser = erase_pieces(A_lesser, lo, mid, 1, grave, comp, removed);
+        greater = erase_pieces(A_greater, mid + 1, hi, 1, grave, comp, removed);
+    }
+
+    if (found != NIL) {
+        grave.bury_node(found);
+        ++removed;
+    }
+    return join_pieces(lesser, greater);
+}
+
+// empty_graveyard method:
+// destroys every buried subtree into the arena, one thread only
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::empty_graveyard(Graveyard& grave) {
+    Node_arena<Node>& a = arena();
+    for (Node* N = grave.head; N != NIL; ) {
+        Node* next = N->parent();
+        recycle_subtree(N, a);
+        N = next;
+    }
+    grave.head = NIL;
+    grave.tail = NIL;
+}
+
+// consume method:
+// the nodes of other are about to be mixed with ours, so the two arenas
+// share their blocks. other is left empty, still with its own free list.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Piece Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::consume(Red_black_tree& other) {
+    Node_arena<Node>::merge(pool, other.pool);
+    Piece P = other.piece_of();
+    other.root = NIL;
+    other.leftmost = NIL;
+    other.rightmost = NIL;
+    return P;
+}
+
+// join method:
+// T2 is spliced to the right of the tree
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::join(Red_black_tree& T2) {
+    if (&T2 == this) {
+        return;
+    }
+    Piece greater = consume(T2);
+    adopt_piece(join_pieces(piece_of(), greater));
+}
+
+// split method:
+// the node holding k itself goes back to the lesser side
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::split(const K& k, Red_black_tree& T2) {
+    if (&T2 == this) {
+        return;
+    }
+    T2.teardown();
+    Node_arena<Node>::merge(pool, T2.pool);
+
+    Piece lesser, greater;
+    Node* found = split(piece_of(), k, lesser, greater, comp);
+    if (found != NIL) {
+        lesser = join(lesser, found, Piece{NIL, 0});
+    }
+    adopt_piece(lesser);
+    T2.adopt_piece(greater);
+}
+
+// erase_range method:
+// split at lo, then split what is above at hi: [lo, hi) is the node of lo
+// (if any) and the middle piece. The node of hi goes back on the greater
+// side and the outer pieces are joined again.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+std::size_t Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::erase_range(const K& lo, const K& hi) {
+    if (root == NIL || !comp(lo, hi)) {
+        return 0;
+    }
+    Piece lesser, rest, middle, greater;
+    Node* at_lo = split(piece_of(), lo, lesser, rest, comp);
+    Node* at_hi = split(rest, hi, middle, greater, comp);
+    if (at_hi != NIL) {
+        greater = join(Piece{NIL, 0}, at_hi, greater);
+    }
+    adopt_piece(join_pieces(lesser, greater));
+
+    Node_arena<Node>& a = arena();
+    return recycle_subtree(middle.top, a) + recycle_subtree(at_lo, a);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::union_with(Red_black_tree& other, unsigned threads) {
+    if (&other == this) {
+        return;
+    }
+    Piece B = consume(other);
+    Graveyard grave;
+    adopt_piece(union_pieces(piece_of(), B, threads, grave, comp));
+    empty_graveyard(grave);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::intersect_with(Red_black_tree& other, unsigned threads) {
+    if (&other == this) {
+        return;
+    }
+    Piece B = consume(other);
+    Graveyard grave;
+    adopt_piece(intersect_pieces(piece_of(), B, threads, grave, comp));
+    empty_graveyard(grave);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::difference_with(Red_black_tree& other, unsigned threads) {
+    if (&other == this) {
+        teardown();
+        return;
+    }
+    Piece B = consume(other);
+    Graveyard grave;
+    adopt_piece(difference_pieces(piece_of(), B, threads, grave, comp));
+    empty_graveyard(grave);
+}
+
+// erase_batch method:
+// the keys are sorted and made distinct first
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename It>
+std::size_t Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::erase_batch(It first, It last, unsigned threads) {
+    std::vector<K> keys(first, last);
+    std::sort(keys.begin(), keys.end(), comp);
+    keys.erase(std::unique(keys.begin(), keys.end(), [this](const K& a, const K& b) {
+        return !comp(a, b);
+    }), keys.end());
+
+    std::size_t removed = 0;
+    Graveyard grave;
+    adopt_piece(erase_pieces(piece_of(), keys.data(), keys.data() + keys.size(), threads, grave, comp, removed));
+    empty_graveyard(grave);
+    return removed;
+}
+
+
+
+// ~~~~~~~~~~~~~~~ Order statistics:
+// every node knows how many nodes hang below it, so each query is one
+// descent adding up the left subtrees it skips.
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<bool O, typename>
+std::size_t Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::rank(const K& k) const {
+    std::size_t r = 0;
+    Node* N = root;
+    while (N != NIL) {
+        if (comp(N->key, k)) {
+            r += N->left->size + 1;
+            N = N->right;
+        } else {
+            N = N->left;
+        }
+    }
+    return r;
+}
+
+// select_node method:
+// goes left while more than i keys are there, otherwise skips the left
+// subtree and the node itself. NIL when i is out of range.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::select_node(std::size_t i) const {
+    Node* N = root;
+    while (N != NIL) {
+        std::size_t left = N->left->size;
+        if (i < left) {
+            N = N->left;
+        } else if (i == left) {
+            return N;
+        } else {
+            i -= left + 1;
+            N = N->right;
+        }
+    }
+    return NIL;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<bool O, typename>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::select(std::size_t i) {
+    return iterator(select_node(i), this);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<bool O, typename>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::const_iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::select(std::size_t i) const {
+    return const_iterator(select_node(i), this);
+}
+
+// count method:
+// two ranks, O(log n) however many keys are in between
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<bool O, typename>
+std::size_t Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::count(const K& lo, const K& hi) const {
+    if (!comp(lo, hi)) {
+        return 0;
+    }
+    return rank(hi) - rank(lo);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<bool O, typename>
+std::size_t Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::size() const {
+    return root->size;
+}
+
+
+// ~~~~~~~~~~~~~~~ Aggregates:
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename A, typename>
+typename A::value_type Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::reduce() const {
+    return root->aggregate;
+}
+
+// reduce method:
+// finds the top most node inside [lo, hi). Below it, the path towards lo
+// collects whole right subtrees and the path towards hi whole left ones,
+// so at most two root to leaf walks are needed. Combination keeps key order.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename A, typename>
+typename A::value_type Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::reduce(const K& lo, const K& hi) const {
+    Node* N = root;
+    while (N != NIL) {
+        if (comp(N->key, lo)) {
+            N = N->right;
+        } else if (!comp(N->key, hi)) {
+            N = N->left;
+        } else {
+            break;
+        }
+    }
+    if (N == NIL) {
+        return A::identity();
+    }
+
+    // keys >= lo under the left child, built from the right
+    typename A::value_type low = A::identity();
+    for (Node* M = N->left; M != NIL;) {
+        if (comp(M->key, lo)) {
+            M = M->right;
+        } else {
+            low = A::combine(A::combine(A::lift(M->key, M->val), M->right->aggregate), low);
+            M = M->left;
+        }
+    }
+
+    // keys < hi under the right child, built from the left
+    typename A::value_type high = A::identity();
+    for (Node* M = N->right; M != NIL;) {
+        if (comp(M->key, hi)) {
+            high = A::combine(high, A::combine(M->left->aggregate, A::lift(M->key, M->val)));
+            M = M->right;
+        } else {
+            M = M->left;
+        }
+    }
+
+    return A::combine(A::combine(low, A::lift(N->key, N->val)), high);
+}
+
+
+// ~~~~~~~~~~~~~~~ Intervals:
+// the aggregate of a subtree is its greatest end. An interval [s, e)
+// overlaps [lo, hi) when s < hi and lo < e.
+
+// overlap_node method:
+// goes left whenever the left subtree ends after lo. If nothing overlaps
+// there, the interval ending last starts at or after hi, and so does every
+// interval further right: the right side never needs a second look.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::Node* Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::overlap_node(const K& lo, const K& hi) const {
+    Node* N = root;
+    while (N != NIL && comp(lo, N->aggregate)) {
+        if (comp(N->key, hi) && comp(lo, Aggregate::lift(N->key, N->val))) {
+            return N;
+        }
+        if (N->left != NIL && comp(lo, N->left->aggregate)) {
+            N = N->left;
+        } else if (comp(N->key, hi)) {
+            N = N->right;
+        } else {
+            return NIL;
+        }
+    }
+    return NIL;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename A, typename>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::find_any_overlap(const K& lo, const K& hi) {
+    return iterator(overlap_node(lo, hi), this);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename A, typename>
+typename Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::const_iterator Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::find_any_overlap(const K& lo, const K& hi) const {
+    return const_iterator(overlap_node(lo, hi), this);
+}
+
+// visit_overlaps method:
+// a subtree ending at or before lo is skipped whole, and so is everything
+// right of a node starting at or after hi
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Fn>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::visit_overlaps(Node* N, const K& lo, const K& hi, Fn& fn) {
+    if (N == NIL || !comp(lo, N->aggregate)) {
+        return;
+    }
+    visit_overlaps(N->left, lo, hi, fn);
+    if (!comp(N->key, hi)) {
+        return;
+    }
+    if (comp(lo, Aggregate::lift(N->key, N->val))) {
+        fn(N->key, N->val);
+    }
+    visit_overlaps(N->right, lo, hi, fn);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Fn, typename A, typename>
+void Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::for_each_overlap(const K& lo, const K& hi, Fn&& fn) {
+    visit_overlaps(root, lo, hi, fn);
+}
+
+
+// ~~~~~~~~~~~~~~~ Shape and checks:
+// one pre-order walk over the parent links, keeping the depth and the
+// black count of the path to the current node up to date.
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+template<typename Visit>
+bool Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::walk_paths(Visit&& visit) const {
+    Node* N = root;
+    std::size_t depth = 1;
+    std::size_t blacks = root->color() == black ? 1 : 0;
+    while (N != NIL) {
+        if (!visit(N, depth, blacks)) {
+            return false;
+        }
+        Node* next = N->left != NIL ? N->left : N->right;
+        if (next == NIL) {
+            // up to the first ancestor reached from the left that has a right child
+            for (;;) {
+                Node* P = N->parent();
+                if (P == NIL) {
+                    return true;
+                }
+                --depth;
+                blacks -= N->color() == black ? 1 : 0;
+                if (N == P->left && P->right != NIL) {
+                    next = P->right;
+                    N = P;
+                    break;
+                }
+                N = P;
+            }
+        }
+        N = next;
+        ++depth;
+        blacks += N->color() == black ? 1 : 0;
+    }
+    return true;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+std::size_t Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::height() const {
+    std::size_t h = 0;
+    walk_paths([&](Node*, std::size_t depth, std::size_t) {
+        h = std::max(h, depth);
+        return true;
+    });
+    return h;
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+std::size_t Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::black_height() const {
+    return black_height(root);
+}
+
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+double Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::average_depth() const {
+    std::size_t nodes = 0;
+    std::size_t total = 0;
+    walk_paths([&](Node*, std::size_t depth, std::size_t) {
+        ++nodes;
+        total += depth;
+        return true;
+    });
+    return nodes == 0 ? 0.0 : static_cast<double>(total) / static_cast<double>(nodes);
+}
+
+// validate method:
+// the links of a node are checked before the walk follows them, so a
+// broken tree is reported instead of walked astray. The search order is
+// checked locally on the way, then globally by one in-order pass.
+template<typename K, typename V, typename Compare, bool Order_statistics, typename Aggregate>
+bool Red_black_tree<K, V, Compare, Order_statistics, Aggregate>::validate() const {
+    // NIL is shared by every tree (and thread), a write to it is a bug
+    if (NIL->color() != black || NIL->parent() != nullptr || NIL->left != nullptr || NIL->right != nullptr) {
+        return false;
+    }
+    if constexpr (Order_statistics) {
+        if (NIL->size != 0) {
+            return false;
+        }
+    }
+    if (root == NIL) {
+        return leftmost == NIL && rightmost == NIL;
+    }
+    if (minNode(root) != leftmost) {
+        return false;
+    }
+    if (root->color() != black || root->parent() != NIL) {
+        return false;
+    }
+
+    // every path to NIL has as many black nodes as the left spine
+    std::size_t expected_blacks = black_height(root);
+    bool shaped = walk_paths([&](Node* N, std::size_t, std::size_t blacks) {
+        for (Node* child : {N->left, N->right}) {
+            if (child == NIL) {
+                if (blacks != expected_blacks) {
+                    return false;
+                }
+                continue;
+            }
+            if (child->parent() != N) {
+                return false;
+            }
+            if (N->color() == red && child->color() == red) {
+                return false;
+            }
+        }
+        if (N->left != NIL && !comp(N->left->key, N->key)) {
+            return false;
+        }
+        if (N->right != NIL && !comp(N->key, N->right->key)) {
+            return false;
+        }
+        if constexpr (Order_statistics) {
+            if (N->size != N->left->size + N->right->size + 1) {
+                return false;
+            }
+        }
+        return true;
+    });
+    if (!shaped) {
+        return false;
+    }
+
+    Node* previous = minNode(root);
+    for (Node* N = successor(previous); N != NIL; previous = N, N = successor(N)) {
+        if (!comp(previous->key, N->key)) {
+            return false;
+        }
+    }
+    // the walk ended on the greatest node, which the append finger must be
+    return previous == rightmost;
+}
@@ -0,0 +1,130 @@
+#ifndef SHARDED_RBTREE_LIB_H
+#define SHARDED_RBTREE_LIB_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <vector>
+
+#include "RBTree.h"
+
+// Sharded_red_black_tree <K,V,Compare,Hash>:
+// K, V, Compare : as for Red_black_tree
+// Hash : hash of K, used when the shards are picked by hash
+//
+// Multi-writer red black tree. The key space is cut into shards, each one
+// a plain Red_black_tree behind its own reader-writer lock, so writers to
+// different shards never wait on each other and readers share every lock.
+//
+// Keys go to shards either by hash (even spread whatever the keys, but an
+// ordered walk has to merge every shard) or by range, between splitters
+// given up front (an ordered walk visits the shards one after the other,
+// but skewed keys load some shards more than others).
+//
+// Ordered walks take the shared lock of every shard they cover before
+// visiting the first entry, so they see one consistent cut of the tree.
+// Point operations hold a single lock, which is why the two never deadlock.
+template <typename K, typename V, typename Compare = std::less<K>, typename Hash = std::hash<K>>
+struct Sharded_red_black_tree {
+
+    using Tree = Red_black_tree<K, V, Compare>;
+
+    // constructor:
+    // ~ shards picked by hash, 16 of them by default
+    explicit Sharded_red_black_tree(std::size_t count = 16, const Compare& c = Compare(),
+                                    const Hash& h = Hash());
+
+    // constructor overload 1:
+    // ~ shards picked by range: cuts (strictly increasing) split the keys
+    // into cuts.size() + 1 shards, shard i holding the keys k with
+    // cuts[i - 1] <= k < cuts[i]
+    explicit Sharded_red_black_tree(std::vector<K> cuts, const Compare& c = Compare());
+
+    Sharded_red_black_tree(const Sharded_red_black_tree&) = delete;
+    Sharded_red_black_tree& operator=(const Sharded_red_black_tree&) = delete;
+
+    // insert:
+    // ~ adds k,v (replaces the value if k is there, releasing owned ones
+    // as Red_black_tree::insert does). Locks one shard.
+    void insert(const K& k, const V& v);
+
+    // insert_batch:
+    // ~ inserts the key value pairs (p.first, p.second) of [first, last),
+    // grouped by shard so each shard is locked once and filled by
+    // Red_black_tree::insert_batch. Returns how many keys were new.
+    template <typename It>
+    std::size_t insert_batch(It first, It last);
+
+    // remove:
+    // ~ removes k, returns whether it was there
+    bool remove(const K& k);
+
+    // find:
+    // ~ a copy of the value at k (the entry may change once the lock is gone)
+    std::optional<V> find(const K& k) const;
+
+    // contains:
+    bool contains(const K& k) const;
+
+    // size:
+    // ~ number of entries, summed shard by shard (not one consistent cut)
+    std::size_t size() const;
+
+    // for_each_in_range:
+    // ~ calls fn(key, val) for lo <= key < hi, in key order. fn runs with
+    // the shards shared locked, it must not write to this tree.
+    template <typename Fn>
+    void for_each_in_range(const K& lo, const K& hi, Fn&& fn) const;
+
+    // for_each:
+    // ~ calls fn(key, val) for every entry, in key order (same rules)
+    template <typename Fn>
+    void for_each(Fn&& fn) const;
+
+    // shard_count, shard_of:
+    // ~ number of shards and the shard k belongs to
+    std::size_t shard_count() const;
+    std::size_t shard_of(const K& k) const;
+
+    // by_range:
+    // ~ whether the shards are picked by range
+    bool by_range() const;
+
+    private:
+
+        // Shard struct:
+        // one tree and its lock, on cache lines of their own so the locks of
+        // neighbouring shards are not bounced between cores together
+        struct alignas(64) Shard {
+            explicit Shard(const Compare& c);
+
+            mutable std::shared_mutex lock;
+            Tree tree;
+            std::size_t count = 0;
+        };
+
+        using Tree_iterator = typename Tree::const_iterator;
+
+        std::vector<std::unique_ptr<Shard>> shards;
+        // empty when the shards are picked by hash
+        std::vector<K> splitters;
+        Compare comp;
+        Hash hash;
+
+        // walk:
+        // the ordered walk behind for_each_in_range and for_each, over the
+        // keys not less than *lo and less than *hi (no bound when null)
+        template <typename Fn>
+        void walk(const K* lo, const K* hi, Fn& fn) const;
+
+        // merge_shards:
+        // k way merge of the shards [first, last), all of them locked
+        template <typename Fn>
+        void merge_shards(std::size_t first, std::size_t last, const K* lo, const K* hi, Fn& fn) const;
+};
+
+#include "ShardedRBTree.impl.h"
+#endif //SHARDED_RBTREE_LIB_H
@@ -0,0 +1,222 @@
+#include "ShardedRBTree.h"
+
+#include <algorithm>
+#include <mutex>
+#include <utility>
+
+// Sharded variant of the RBTree library.
+// Every shard is an ordinary Red_black_tree; this file only decides which
+// shard a key goes to and which locks an operation holds.
+
+
+// SHARD CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template<typename K, typename V, typename Compare, typename Hash>
+Sharded_red_black_tree<K, V, Compare, Hash>::Shard::Shard(const Compare& c) : tree(c) {}
+
+template<typename K, typename V, typename Compare, typename Hash>
+Sharded_red_black_tree<K, V, Compare, Hash>::Sharded_red_black_tree(std::size_t count, const Compare& c,
+                                                                    const Hash& h)
+    : comp(c), hash(h) {
+    count = std::max<std::size_t>(count, 1);
+    shards.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        shards.push_back(std::make_unique<Shard>(comp));
+    }
+}
+
+template<typename K, typename V, typename Compare, typename Hash>
+Sharded_red_black_tree<K, V, Compare, Hash>::Sharded_red_black_tree(std::vector<K> cuts, const Compare& c)
+    : splitters(std::move(cuts)), comp(c) {
+    shards.reserve(splitters.size() + 1);
+    for (std::size_t i = 0; i <= splitters.size(); ++i) {
+        shards.push_back(std::make_unique<Shard>(comp));
+    }
+}
+
+template<typename K, typename V, typename Compare, typename Hash>
+std::size_t Sharded_red_black_tree<K, V, Compare, Hash>::shard_count() const {
+    return shards.size();
+}
+
+template<typename K, typename V, typename Compare, typename Hash>
+bool Sharded_red_black_tree<K, V, Compare, Hash>::by_range() const {
+    return !splitters.empty();
+}
+
+// shard_of method:
+// by range, the number of splitters not greater than k. By hash, the hash
+// is mixed first (std::hash of an integer is often the integer itself,
+// and keys sharing their low bits would all land in a few shards).
+template<typename K, typename V, typename Compare, typename Hash>
+std::size_t Sharded_red_black_tree<K, V, Compare, Hash>::shard_of(const K& k) const {
+    if (by_range()) {
+        return std::upper_bound(splitters.begin(), splitters.end(), k, comp) - splitters.begin();
+    }
+    std::uint64_t h = static_cast<std::uint64_t>(hash(k)) * 0x9e3779b97f4a7c15ull;
+    return static_cast<std::size_t>((h >> 32) % shards.size());
+}
+
+
+// WRITE CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// insert method:
+// an overwrite goes through the hinted insert of the shard, placed at the
+// entry try_emplace found, so an owned value or key is released as
+// Red_black_tree::insert would
+template<typename K, typename V, typename Compare, typename Hash>
+void Sharded_red_black_tree<K, V, Compare, Hash>::insert(const K& k, const V& v) {
+    Shard& s = *shards[shard_of(k)];
+    std::unique_lock<std::shared_mutex> lock(s.lock);
+    auto [it, added] = s.tree.try_emplace(k, v);
+    if (added) {
+        ++s.count;
+    } else {
+        s.tree.insert(it, k, v);
+    }
+}
+
+template<typename K, typename V, typename Compare, typename Hash>
+template <typename It>
+std::size_t Sharded_red_black_tree<K, V, Compare, Hash>::insert_batch(It first, It last) {
+    std::vector<std::vector<std::pair<K, V>>> groups(shards.size());
+    for (; first != last; ++first) {
+        groups[shard_of(first->first)].emplace_back(first->first, first->second);
+    }
+
+    std::size_t added = 0;
+    for (std::size_t i = 0; i < groups.size(); ++i) {
+        if (groups[i].empty()) {
+            continue;
+        }
+        Shard& s = *shards[i];
+        std::unique_lock<std::shared_mutex> lock(s.lock);
+        std::size_t fresh = s.tree.insert_batch(groups[i].begin(), groups[i].end());
+        s.count += fresh;
+        added += fresh;
+    }
+    return added;
+}
+
+template<typename K, typename V, typename Compare, typename Hash>
+bool Sharded_red_black_tree<K, V, Compare, Hash>::remove(const K& k) {
+    Shard& s = *shards[shard_of(k)];
+    std::unique_lock<std::shared_mutex> lock(s.lock);
+    if (!s.tree.remove(k)) {
+        return false;
+    }
+    --s.count;
+    return true;
+}
+
+
+// READ CODE!! ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template<typename K, typename V, typename Compare, typename Hash>
+std::optional<V> Sharded_red_black_tree<K, V, Compare, Hash>::find(const K& k) const {
+    const Shard& s = *shards[shard_of(k)];
+    std::shared_lock<std::shared_mutex> lock(s.lock);
+    const V* v = s.tree.find(k);
+    return v ? std::optional<V>(*v) : std::nullopt;
+}
+
+template<typename K, typename V, typename Compare, typename Hash>
+bool Sharded_red_black_tree<K, V, Compare, Hash>::contains(const K& k) const {
+    const Shard& s = *shards[shard_of(k)];
+    std::shared_lock<std::shared_mutex> lock(s.lock);
+    return s.tree.contains(k);
+}
+
+template<typename K, typename V, typename Compare, typename Hash>
+std::size_t Sharded_red_black_tree<K, V, Compare, Hash>::size() const {
+    std::size_t total = 0;
+    for (const std::unique_ptr<Shard>& s : shards) {
+        std::shared_lock<std::shared_mutex> lock(s->lock);
+        total += s->count;
+    }
+    return total;
+}
+
+template<typename K, typename V, typename Compare, typename Hash>
+template <typename Fn>
+void Sharded_red_black_tree<K, V, Compare, Hash>::for_each_in_range(const K& lo, const K& hi, Fn&& fn) const {
+    if (!comp(lo, hi)) {
+        return;
+    }
+    walk(&lo, &hi, fn);
+}
+
+template<typename K, typename V, typename Compare, typename Hash>
+template <typename Fn>
+void Sharded_red_black_tree<K, V, Compare, Hash>::for_each(Fn&& fn) const {
+    walk(nullptr, nullptr, fn);
+}
+
+// walk method:
+// range shards hold consecutive key ranges, so only those meeting [lo, hi)
+// are locked and their merge is a concatenation. Hash shards all hold keys
+// anywhere, every one is locked and merged. Locks are taken in shard order.
+template<typename K, typename V, typename Compare, typename Hash>
+template <typename Fn>
+void Sharded_red_black_tree<K, V, Compare, Hash>::walk(const K* lo, const K* hi, Fn& fn) const {
+    std::size_t first = 0;
+    std::size_t last = shards.size();
+    if (by_range()) {
+        first = lo ? shard_of(*lo) : 0;
+        last = hi ? shard_of(*hi) + 1 : shards.size();
+    }
+
+    std::vector<std::shared_lock<std::shared_mutex>> held;
+    held.reserve(last - first);
+    for (std::size_t i = first; i < last; ++i) {
+        held.emplace_back(shards[i]->lock);
+    }
+
+    if (!by_range()) {
+        merge_shards(first, last, lo, hi, fn);
+        return;
+    }
+    for (std::size_t i = first; i < last; ++i) {
+        const Tree& t = shards[i]->tree;
+        for (Tree_iterator it = lo ? t.lower_bound(*lo) : t.begin(); it != t.end(); ++it) {
+            if (hi && !comp(it->key, *hi)) {
+                return;
+            }
+            fn(it->key, it->val);
+        }
+    }
+}
+
+template<typename K, typename V, typename Compare, typename Hash>
+template <typename Fn>
+void Sharded_red_black_tree<K, V, Compare, Hash>::merge_shards(std::size_t first, std::size_t last, const K* lo,
+                                                               const K* hi, Fn& fn) const {
+    // one cursor per shard with entries left, the smallest key on top
+    struct Cursor {
+        Tree_iterator at;
+        Tree_iterator end;
+    };
+    std::vector<Cursor> heap;
+    heap.reserve(last - first);
+    for (std::size_t i = first; i < last; ++i) {
+        const Tree& t = shards[i]->tree;
+        Tree_iterator it = lo ? t.lower_bound(*lo) : t.begin();
+        if (it != t.end() && (!hi || comp(it->key, *hi))) {
+            heap.push_back({it, t.end()});
+        }
+    }
+    auto later = [this](const Cursor& a, const Cursor& b) { return comp(b.at->key, a.at->key); };
+    std::make_heap(heap.begin(), heap.end(), later);
+
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        Cursor& c = heap.back();
+        fn(c.at->key, c.at->val);
+        ++c.at;
+        if (c.at != c.end && (!hi || comp(c.at->key, *hi))) {
+            std::push_heap(heap.begin(), heap.end(), later);
+        } else {
+            heap.pop_back();
+        }
+    }
+}
@@ -0,0 +1,1488 @@
+// RBTree benchmark harness.
+// Self-contained, runs offline on Linux, no dependency besides the library.
+//
+// Build:  g++ -std=c++17 -O2 -pthread benchmark.cpp -o benchmark
+// Usage:  ./benchmark [--max N] [--min N] [--filter text]
+//   --min, --max : smallest and largest size, sizes go up by 10x (default 1K to 1M,
+//                  pass --max 100000000 for the full range)
+//   --filter     : only run the cases whose "workload/container" contains text
+//
+// Every (workload, container, size) case runs in a forked child, so the peak RSS
+// reported is the one of that case alone. Cache misses come from perf_event_open
+// and read n/a where the kernel does not allow it.
+// The insert_string cases also report key comparisons per insert, counted
+// by their comparator.
+//
+// Containers: Red_black_tree, std::map, std::set (keys only) and a small
+// B+ tree baseline defined below. The concurrent_lookup cases compare
+// Concurrent_red_black_tree against a Red_black_tree behind a mutex, the
+// overlap cases an Interval_tree against a linear scan of the intervals,
+// the frozen cases a Frozen_index (lookups and scans only). The
+// concurrent_insert_w* cases scale writers from 1 to 64 threads against
+// Sharded_red_black_tree (by hash and by range), the copy on write tree and
+// a tree behind a mutex. The hinted cases insert with end() as the hint
+// into a Red_black_tree and a std::map. The erase and window cases leave
+// the B+ tree out (it has no erase). The queue cases run a deadline queue
+// on pop_min against std::map (begin() erased) and std::priority_queue.
+// lookup_batch answers the keys of lookup_loop with find_batch. The int
+// set cases pit Red_black_set<int> against std::set<int>. The clone cases
+// copy a whole tree (clone_t4 on 4 threads) against a std::map copy.
+// union, intersect and difference run the set algebra of two trees of n
+// keys sharing half of them (the _t4 cases on 4 threads) against the same
+// result reached one key at a time (the _loop cases, on both containers).
+//
+// Add -march=native (or -mavx2) to let the frozen index compare keys with SIMD.
+
+#include "RBTree.h"
+#include "ConcurrentRBTree.h"
+#include "FrozenIndex.h"
+#include "ShardedRBTree.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using u64 = std::uint64_t;
+
+// KEY GENERATION ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// splitmix64: cheap, well mixed, reproducible
+static u64 mix(u64 x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// present keys are even, so odd keys always miss
+static u64 random_key(u64 i) {
+    return mix(i) & ~u64(1);
+}
+
+// Zipf:
+// ranks in [0, n) with skew theta, YCSB style (Gray et al.)
+struct Zipf {
+    Zipf(u64 n, double theta) : n(n), theta(theta) {
+        double zeta_n = 0;
+        for (u64 i = 1; i <= n; ++i) {
+            zeta_n += 1.0 / std::pow(double(i), theta);
+        }
+        zeta2 = 1.0 + 1.0 / std::pow(2.0, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - std::pow(2.0 / double(n), 1.0 - theta)) / (1.0 - zeta2 / zeta_n);
+        zetan = zeta_n;
+    }
+
+    u64 operator()(u64 i) const {
+        double u = double(mix(i ^ 0x5a5a5a5a) >> 11) / double(u64(1) << 53);
+        double uz = u * zetan;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < zeta2) {
+            return 1;
+        }
+        return std::min<u64>(n - 1, u64(double(n) * std::pow(eta * u - eta + 1.0, alpha)));
+    }
+
+    u64 n;
+    double theta, zetan, zeta2, alpha, eta;
+};
+
+
+// B+ TREE BASELINE ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Btree:
+// minimal B+ tree with linked leaves, insert / find / ordered scan only.
+// Fanout 64, keys stored in sorted arrays and searched linearly.
+struct Btree {
+    static constexpr int fanout = 64;
+
+    struct Page {
+        bool leaf;
+        int count = 0;
+        u64 keys[fanout];
+    };
+    struct Leaf : Page {
+        u64 vals[fanout];
+        Leaf* next = nullptr;
+    };
+    struct Inner : Page {
+        Page* kids[fanout + 1];
+    };
+
+    Btree() {
+        root = new_leaf();
+    }
+
+    ~Btree() {
+        destroy(root);
+    }
+
+    void insert(u64 k, u64 v) {
+        u64 up_key;
+        Page* up_page = insert(root, k, v, up_key);
+        if (up_page != nullptr) {
+            Inner* r = new Inner();
+            r->leaf = false;
+            r->count = 1;
+            r->keys[0] = up_key;
+            r->kids[0] = root;
+            r->kids[1] = up_page;
+            root = r;
+        }
+    }
+
+    const u64* find(u64 k) const {
+        const Leaf* l = leaf_for(k);
+        int i = position(l, k);
+        return i < l->count && l->keys[i] == k ? &l->vals[i] : nullptr;
+    }
+
+    template <typename Fn>
+    void for_each_in_range(u64 lo, u64 hi, Fn&& fn) const {
+        const Leaf* l = leaf_for(lo);
+        for (int i = position(l, lo); l != nullptr; l = l->next, i = 0) {
+            for (; i < l->count; ++i) {
+                if (l->keys[i] >= hi) {
+                    return;
+                }
+                fn(l->keys[i], l->vals[i]);
+            }
+        }
+    }
+
+    private:
+
+        Page* root;
+
+        static Leaf* new_leaf() {
+            Leaf* l = new Leaf();
+            l->leaf = true;
+            return l;
+        }
+
+        // first slot whose key is not less than k
+        static int position(const Page* p, u64 k) {
+            int i = 0;
+            while (i < p->count && p->keys[i] < k) {
+                ++i;
+            }
+            return i;
+        }
+
+        // child slot to follow for k (separators are the first key on their right)
+        static int child_slot(const Inner* p, u64 k) {
+            int i = 0;
+            while (i < p->count && p->keys[i] <= k) {
+                ++i;
+            }
+            return i;
+        }
+
+        const Leaf* leaf_for(u64 k) const {
+            const Page* p = root;
+            while (!p->leaf) {
+                const Inner* in = static_cast<const Inner*>(p);
+                p = in->kids[child_slot(in, k)];
+            }
+            return static_cast<const Leaf*>(p);
+        }
+
+        // returns the new right sibling when p had to split, with its separator
+        Page* insert(Page* p, u64 k, u64 v, u64& up_key) {
+            if (p->leaf) {
+                Leaf* l = static_cast<Leaf*>(p);
+                int i = position(l, k);
+                if (i < l->count && l->keys[i] == k) {
+                    l->vals[i] = v;
+                    return nullptr;
+                }
+                std::memmove(l->keys + i + 1, l->keys + i, (l->count - i) * sizeof(u64));
+                std::memmove(l->vals + i + 1, l->vals + i, (l->count - i) * sizeof(u64));
+                l->keys[i] = k;
+                l->vals[i] = v;
+                if (++l->count < fanout) {
+                    return nullptr;
+                }
+                Leaf* r = new_leaf();
+                int half = l->count / 2;
+                r->count = l->count - half;
+                std::memcpy(r->keys, l->keys + half, r->count * sizeof(u64));
+                std::memcpy(r->vals, l->vals + half, r->count * sizeof(u64));
+                l->count = half;
+                r->next = l->next;
+                l->next = r;
+                up_key = r->keys[0];
+                return r;
+            }
+
+            Inner* in = static_cast<Inner*>(p);
+            int i = child_slot(in, k);
+            u64 child_key;
+            Page* child = insert(in->kids[i], k, v, child_key);
+            if (child == nullptr) {
+                return nullptr;
+            }
+            std::memmove(in->keys + i + 1, in->keys + i, (in->count - i) * sizeof(u64));
+            std::memmove(in->kids + i + 2, in->kids + i + 1, (in->count - i) * sizeof(Page*));
+            in->keys[i] = child_key;
+            in->kids[i + 1] = child;
+            if (++in->count < fanout) {
+                return nullptr;
+            }
+            Inner* r = new Inner();
+            r->leaf = false;
+            int half = in->count / 2;
+            up_key = in->keys[half];
+            r->count = in->count - half - 1;
+            std::memcpy(r->keys, in->keys + half + 1, r->count * sizeof(u64));
+            std::memcpy(r->kids, in->kids + half + 1, (r->count + 1) * sizeof(Page*));
+            in->count = half;
+            return r;
+        }
+
+        static void destroy(Page* p) {
+            if (p->leaf) {
+                delete static_cast<Leaf*>(p);
+                return;
+            }
+            Inner* in = static_cast<Inner*>(p);
+            for (int i = 0; i <= in->count; ++i) {
+                destroy(in->kids[i]);
+            }
+            delete in;
+        }
+};
+
+
+// CONTAINER ADAPTERS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+struct Rb_adapter {
+    static constexpr const char* name = "rbtree";
+    Red_black_tree<u64, u64> t;
+
+    void insert(u64 k, u64 v) { t.insert(k, v); }
+    bool find(u64 k) const { return t.find(k) != nullptr; }
+    template <typename Fn> void scan(u64 lo, u64 hi, Fn&& fn) { t.for_each_in_range(lo, hi, fn); }
+    void bulk(const std::vector<std::pair<u64, u64>>& sorted) { t.assign_sorted(sorted.begin(), sorted.end()); }
+    void batch(const std::vector<std::pair<u64, u64>>& b) { t.insert_batch(b.begin(), b.end()); }
+    void insert_at_end(u64 k, u64 v) { t.insert(t.cend(), k, v); }
+    void erase(u64 k) { t.remove(k); }
+    void expire(u64 lo, u64 hi) { t.erase_range(lo, hi); }
+    u64 pop_min() { return t.pop_min()->first; }
+    u64 find_batch(const u64* first, const u64* last, const u64** out) const {
+        return t.find_batch(first, last, out);
+    }
+    Rb_adapter clone(unsigned threads) const {
+        Rb_adapter copy;
+        copy.t = t.clone(threads);
+        return copy;
+    }
+    void union_with(Rb_adapter& other, unsigned threads) { t.union_with(other.t, threads); }
+    void intersect_with(Rb_adapter& other, unsigned threads) { t.intersect_with(other.t, threads); }
+    void difference_with(Rb_adapter& other, unsigned threads) { t.difference_with(other.t, threads); }
+};
+
+struct Map_adapter {
+    static constexpr const char* name = "std::map";
+    std::map<u64, u64> t;
+
+    void insert(u64 k, u64 v) { t.insert_or_assign(k, v); }
+    bool find(u64 k) const { return t.find(k) != t.end(); }
+    template <typename Fn> void scan(u64 lo, u64 hi, Fn&& fn) {
+        for (auto it = t.lower_bound(lo); it != t.end() && it->first < hi; ++it) {
+            fn(it->first, it->second);
+        }
+    }
+    void bulk(const std::vector<std::pair<u64, u64>>& sorted) { t = std::map<u64, u64>(sorted.begin(), sorted.end()); }
+    void batch(const std::vector<std::pair<u64, u64>>& b) {
+        for (auto& p : b) {
+            t.insert_or_assign(p.first, p.second);
+        }
+    }
+    void insert_at_end(u64 k, u64 v) { t.insert_or_assign(t.end(), k, v); }
+    void erase(u64 k) { t.erase(k); }
+    void expire(u64 lo, u64 hi) { t.erase(t.lower_bound(lo), t.lower_bound(hi)); }
+    Map_adapter clone(unsigned) const { return *this; }
+    u64 pop_min() {
+        auto first = t.begin();
+        u64 k = first->first;
+        t.erase(first);
+        return k;
+    }
+};
+
+struct Set_adapter {
+    static constexpr const char* name = "std::set";
+    std::set<u64> t;
+
+    void insert(u64 k, u64) { t.insert(k); }
+    bool find(u64 k) const { return t.find(k) != t.end(); }
+    template <typename Fn> void scan(u64 lo, u64 hi, Fn&& fn) {
+        for (auto it = t.lower_bound(lo); it != t.end() && *it < hi; ++it) {
+            fn(*it, *it);
+        }
+    }
+    void bulk(const std::vector<std::pair<u64, u64>>& sorted) {
+        std::vector<u64> keys;
+        keys.reserve(sorted.size());
+        for (auto& p : sorted) {
+            keys.push_back(p.first);
+        }
+        t = std::set<u64>(keys.begin(), keys.end());
+    }
+    void batch(const std::vector<std::pair<u64, u64>>& b) {
+        for (auto& p : b) {
+            t.insert(p.first);
+        }
+    }
+    void erase(u64 k) { t.erase(k); }
+    void expire(u64 lo, u64 hi) { t.erase(t.lower_bound(lo), t.lower_bound(hi)); }
+};
+
+struct Btree_adapter {
+    static constexpr const char* name = "btree";
+    Btree t;
+
+    void insert(u64 k, u64 v) { t.insert(k, v); }
+    bool find(u64 k) const { return t.find(k) != nullptr; }
+    template <typename Fn> void scan(u64 lo, u64 hi, Fn&& fn) { t.for_each_in_range(lo, hi, fn); }
+    void bulk(const std::vector<std::pair<u64, u64>>& sorted) {
+        for (auto& p : sorted) {
+            t.insert(p.first, p.second);
+        }
+    }
+    void batch(const std::vector<std::pair<u64, u64>>& b) { bulk(b); }
+};
+
+// int set adapters: only insert and find, keys cut down to int (the top
+// 31 bits of the key and its low bit, so lookup_miss keys still miss)
+
+static int int_key(u64 k) {
+    return static_cast<int>(static_cast<std::uint32_t>(((k >> 33) << 1) | (k & 1)));
+}
+
+struct Rb_int_set_adapter {
+    static constexpr const char* name = "rbset<int>";
+    Red_black_set<int> t;
+
+    void insert(u64 k, u64) { t.insert(int_key(k)); }
+    bool find(u64 k) const { return t.contains(int_key(k)); }
+};
+
+struct Std_int_set_adapter {
+    static constexpr const char* name = "std::set<int>";
+    std::set<int> t;
+
+    void insert(u64 k, u64) { t.insert(int_key(k)); }
+    bool find(u64 k) const { return t.find(int_key(k)) != t.end(); }
+};
+
+// string key adapters: keys ordered by Counting_less, which counts every
+// comparison, so the insert_string cases report comparisons per insert
+
+static u64 comparisons = 0;
+
+struct Counting_less {
+    bool operator()(const std::string& a, const std::string& b) const {
+        ++comparisons;
+        return a < b;
+    }
+};
+
+struct Rb_string_adapter {
+    static constexpr const char* name = "rbtree<string>";
+    Red_black_tree<std::string, u64, Counting_less> t;
+
+    void insert(const std::string& k, u64 v) { t.insert(k, v); }
+};
+
+struct Map_string_adapter {
+    static constexpr const char* name = "std::map<string>";
+    std::map<std::string, u64, Counting_less> t;
+
+    void insert(const std::string& k, u64 v) { t.insert_or_assign(k, v); }
+};
+
+// queue adapter: only insert and pop_min, the binary heap baseline for the
+// deadline queue workloads
+
+struct Heap_adapter {
+    static constexpr const char* name = "std::priority_queue";
+    using Entry = std::pair<u64, u64>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> t;
+
+    void insert(u64 k, u64 v) { t.emplace(k, v); }
+    u64 pop_min() {
+        u64 k = t.top().first;
+        t.pop();
+        return k;
+    }
+};
+
+// frozen adapter: inserts go to a tree, which seal() freezes once the
+// workload is done filling (untimed), lookups and scans hit the frozen copy
+
+struct Frozen_adapter {
+    static constexpr const char* name = "frozen";
+    Red_black_tree<u64, u64> staging;
+    Frozen_index<u64, u64> t;
+
+    void insert(u64 k, u64 v) { staging.insert(k, v); }
+    void seal() { t = staging.freeze(); }
+    bool find(u64 k) const { return t.find(k) != nullptr; }
+    template <typename Fn> void scan(u64 lo, u64 hi, Fn&& fn) { t.for_each_in_range(lo, hi, fn); }
+};
+
+// concurrent adapters: only insert and find, both callable from any thread
+
+struct Cow_adapter {
+    static constexpr const char* name = "cow_rbtree";
+    Concurrent_red_black_tree<u64, u64> t;
+
+    void insert(u64 k, u64 v) { t.insert(k, v); }
+    bool find(u64 k) const { return t.contains(k); }
+};
+
+struct Locked_adapter {
+    static constexpr const char* name = "locked_rbtree";
+    Red_black_tree<u64, u64> t;
+    mutable std::mutex m;
+
+    void insert(u64 k, u64 v) {
+        std::lock_guard<std::mutex> lock(m);
+        t.insert(k, v);
+    }
+    bool find(u64 k) const {
+        std::lock_guard<std::mutex> lock(m);
+        return t.find(k) != nullptr;
+    }
+};
+
+struct Sharded_adapter {
+    static constexpr const char* name = "sharded_rbtree";
+    Sharded_red_black_tree<u64, u64> t{64};
+
+    void insert(u64 k, u64 v) { t.insert(k, v); }
+    bool find(u64 k) const { return t.contains(k); }
+};
+
+// keys are uniform over u64, so 64 equal slices of it balance the shards
+struct Range_sharded_adapter {
+    static constexpr const char* name = "range_sharded_rbtree";
+    Sharded_red_black_tree<u64, u64> t{slices()};
+
+    static std::vector<u64> slices() {
+        std::vector<u64> s;
+        for (u64 i = 1; i < 64; ++i) {
+            s.push_back(i << 58);
+        }
+        return s;
+    }
+    void insert(u64 k, u64 v) { t.insert(k, v); }
+    bool find(u64 k) const { return t.contains(k); }
+};
+
+// interval adapters: [start, end) intervals keyed by start
+
+struct Interval_adapter {
+    static constexpr const char* name = "interval_tree";
+    static constexpr u64 max_queries = ~u64(0);
+    Interval_tree<u64, u64> t;
+
+    void insert(u64 start, u64 end) { t.insert(start, end); }
+    bool any(u64 lo, u64 hi) { return t.find_any_overlap(lo, hi) != t.end(); }
+    template <typename Fn> void all(u64 lo, u64 hi, Fn&& fn) { t.for_each_overlap(lo, hi, fn); }
+};
+
+struct Scan_adapter {
+    static constexpr const char* name = "linear_scan";
+    // every query reads all n intervals, so only this many are timed
+    static constexpr u64 max_queries = 1000;
+    std::vector<std::pair<u64, u64>> t;
+
+    void insert(u64 start, u64 end) { t.push_back({start, end}); }
+    bool any(u64 lo, u64 hi) {
+        for (auto& i : t) {
+            if (i.first < hi && lo < i.second) {
+                return true;
+            }
+        }
+        return false;
+    }
+    template <typename Fn> void all(u64 lo, u64 hi, Fn&& fn) {
+        for (auto& i : t) {
+            if (i.first < hi && lo < i.second) {
+                fn(i.first, i.second);
+            }
+        }
+    }
+};
+
+
+// MEASUREMENT ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Cache_counter:
+// hardware cache misses of this process, user space only
+struct Cache_counter {
+    Cache_counter() {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof attr;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~Cache_counter() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    void start() {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    // -1 when not available
+    long long stop() {
+        if (fd < 0) {
+            return -1;
+        }
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        long long count = 0;
+        if (read(fd, &count, sizeof count) != sizeof count) {
+            return -1;
+        }
+        return count;
+    }
+
+    int fd;
+};
+
+// Result:
+// what a child reports back through its pipe
+struct Result {
+    double ns_per_op;
+    double misses_per_op;
+    // only the cases counting key comparisons set it
+    double comparisons_per_op = -1;
+};
+
+// Timer:
+// wall clock and cache misses around the measured region only
+struct Timer {
+    void start() {
+        cache.start();
+        begin = std::chrono::steady_clock::now();
+    }
+
+    Result stop(u64 ops) {
+        auto end = std::chrono::steady_clock::now();
+        long long misses = cache.stop();
+        double ns = std::chrono::duration<double, std::nano>(end - begin).count();
+        return Result{ns / double(ops), misses < 0 ? -1.0 : double(misses) / double(ops)};
+    }
+
+    Cache_counter cache;
+    std::chrono::steady_clock::time_point begin;
+};
+
+// keeps results alive so the optimizer cannot drop lookups
+static volatile u64 sink;
+
+
+// WORKLOADS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// each one builds what it needs untimed, then times n operations
+
+// has_seal:
+// adapters that must see every key before the first lookup
+template <typename C, typename = void> struct has_seal : std::false_type {};
+template <typename C> struct has_seal<C, std::void_t<decltype(std::declval<C&>().seal())>> : std::true_type {};
+
+template <typename C>
+static void fill_random(C& c, u64 n) {
+    for (u64 i = 0; i < n; ++i) {
+        c.insert(random_key(i), i);
+    }
+    if constexpr (has_seal<C>::value) {
+        c.seal();
+    }
+}
+
+template <typename C>
+static Result insert_random(u64 n) {
+    C c;
+    Timer t;
+    t.start();
+    fill_random(c, n);
+    return t.stop(n);
+}
+
+// insert_string:
+// random decimal string keys, built untimed. Reports ns and key
+// comparisons per insert.
+template <typename C>
+static Result insert_string(u64 n) {
+    std::vector<std::string> keys(n);
+    for (u64 i = 0; i < n; ++i) {
+        keys[i] = std::to_string(random_key(i));
+    }
+    C c;
+    comparisons = 0;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; ++i) {
+        c.insert(keys[i], i);
+    }
+    Result r = t.stop(n);
+    r.comparisons_per_op = double(comparisons) / double(n);
+    return r;
+}
+
+template <typename C>
+static Result insert_sequential(u64 n) {
+    C c;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; ++i) {
+        c.insert(i, i);
+    }
+    return t.stop(n);
+}
+
+// nearly_sorted_key:
+// increasing timestamps, one in 8 of them late by up to 64 places
+static u64 nearly_sorted_key(u64 i) {
+    u64 late = mix(i) % 8 == 0 ? mix(i ^ 0x5bd1e995ull) % 64 : 0;
+    u64 at = i > late ? i - late : 0;
+    return at * 16 + i % 16;
+}
+
+template <typename C>
+static Result insert_nearly_sorted(u64 n) {
+    C c;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; ++i) {
+        c.insert(nearly_sorted_key(i), i);
+    }
+    return t.stop(n);
+}
+
+// hinted inserts: every key comes with end() as its hint
+
+template <typename C>
+static Result hinted_sequential(u64 n) {
+    C c;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; ++i) {
+        c.insert_at_end(i, i);
+    }
+    return t.stop(n);
+}
+
+template <typename C>
+static Result hinted_nearly_sorted(u64 n) {
+    C c;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; ++i) {
+        c.insert_at_end(nearly_sorted_key(i), i);
+    }
+    return t.stop(n);
+}
+
+template <typename C>
+static Result hinted_random(u64 n) {
+    C c;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; ++i) {
+        c.insert_at_end(random_key(i), i);
+    }
+    return t.stop(n);
+}
+
+template <typename C>
+static Result insert_zipf(u64 n) {
+    Zipf z(n, 0.99);
+    std::vector<u64> keys(n);
+    for (u64 i = 0; i < n; ++i) {
+        keys[i] = random_key(z(i));
+    }
+    C c;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; ++i) {
+        c.insert(keys[i], i);
+    }
+    return t.stop(n);
+}
+
+template <typename C>
+static Result lookup_hit(u64 n) {
+    C c;
+    fill_random(c, n);
+    u64 found = 0;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; ++i) {
+        found += c.find(random_key(mix(i) % n));
+    }
+    Result r = t.stop(n);
+    sink = found;
+    return r;
+}
+
+// lookup_loop, lookup_batch:
+// lookup hits handed over in requests of request_keys keys, answered by a
+// find per key or by one find_batch per request
+static constexpr u64 request_keys = 1024;
+
+static std::vector<u64> hit_keys(u64 n) {
+    std::vector<u64> keys(n);
+    for (u64 i = 0; i < n; ++i) {
+        keys[i] = random_key(mix(i) % n);
+    }
+    return keys;
+}
+
+template <typename C>
+static Result lookup_loop(u64 n) {
+    C c;
+    fill_random(c, n);
+    std::vector<u64> keys = hit_keys(n);
+    u64 found = 0;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; ++i) {
+        found += c.find(keys[i]);
+    }
+    Result r = t.stop(n);
+    sink = found;
+    return r;
+}
+
+template <typename C>
+static Result lookup_batch(u64 n) {
+    C c;
+    fill_random(c, n);
+    std::vector<u64> keys = hit_keys(n);
+    std::vector<const u64*> out(request_keys);
+    u64 found = 0;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; i += request_keys) {
+        u64 end = std::min(n, i + request_keys);
+        found += c.find_batch(keys.data() + i, keys.data() + end, out.data());
+    }
+    Result r = t.stop(n);
+    sink = found;
+    return r;
+}
+
+template <typename C>
+static Result lookup_miss(u64 n) {
+    C c;
+    fill_random(c, n);
+    u64 found = 0;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; ++i) {
+        found += c.find(random_key(mix(i) % n) | 1);
+    }
+    Result r = t.stop(n);
+    sink = found;
+    return r;
+}
+
+// mixed:
+// 50% lookups, 25% overwrites of present keys, 25% inserts of new keys
+template <typename C>
+static Result mixed(u64 n) {
+    C c;
+    fill_random(c, n);
+    u64 fresh = n;
+    u64 found = 0;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; ++i) {
+        u64 dice = mix(i + 7) & 3;
+        if (dice < 2) {
+            found += c.find(random_key(mix(i) % fresh));
+        } else if (dice == 2) {
+            c.insert(random_key(mix(i) % fresh), i);
+        } else {
+            c.insert(random_key(fresh++), i);
+        }
+    }
+    Result r = t.stop(n);
+    sink = found;
+    return r;
+}
+
+// mixed_erase:
+// 40% lookups, 20% overwrites, 20% inserts of new keys, 20% erases of
+// present keys, so the size stays about n
+template <typename C>
+static Result mixed_erase(u64 n) {
+    C c;
+    fill_random(c, n);
+    u64 fresh = n;
+    u64 oldest = 0;
+    u64 found = 0;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; ++i) {
+        u64 dice = mix(i + 7) % 5;
+        if (dice < 2) {
+            found += c.find(random_key(oldest + mix(i) % (fresh - oldest)));
+        } else if (dice == 2) {
+            c.insert(random_key(oldest + mix(i) % (fresh - oldest)), i);
+        } else if (dice == 3) {
+            c.insert(random_key(fresh++), i);
+        } else {
+            c.erase(random_key(oldest++));
+        }
+    }
+    Result r = t.stop(n);
+    sink = found;
+    return r;
+}
+
+// window_remove, window_expire:
+// a window of the n latest timestamps: each new one pushes the oldest out,
+// one remove at a time, or everything older than the window as one range
+// every expire_every inserts
+static constexpr u64 expire_every = 256;
+
+template <typename C>
+static Result window_remove(u64 n) {
+    C c;
+    for (u64 i = 0; i < n; ++i) {
+        c.insert(i, i);
+    }
+    Timer t;
+    t.start();
+    for (u64 i = n; i < 2 * n; ++i) {
+        c.insert(i, i);
+        c.erase(i - n);
+    }
+    return t.stop(n);
+}
+
+template <typename C>
+static Result window_expire(u64 n) {
+    C c;
+    for (u64 i = 0; i < n; ++i) {
+        c.insert(i, i);
+    }
+    Timer t;
+    t.start();
+    for (u64 i = n; i < 2 * n; ++i) {
+        c.insert(i, i);
+        if ((i + 1) % expire_every == 0) {
+            c.expire(0, i + 1 - n);
+        }
+    }
+    return t.stop(n);
+}
+
+// queue_hold, queue_drain:
+// a deadline queue of n timers. hold: the earliest one fires and is set
+// again a random delay later (the hold model), so the queue keeps n timers.
+// drain: all n fire, earliest first.
+template <typename C>
+static void fill_deadlines(C& c, u64 n) {
+    for (u64 i = 0; i < n; ++i) {
+        c.insert(random_key(i) >> 16, i);
+    }
+}
+
+template <typename C>
+static Result queue_hold(u64 n) {
+    C c;
+    fill_deadlines(c, n);
+    u64 fired = 0;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; ++i) {
+        u64 at = c.pop_min();
+        fired += at;
+        c.insert(at + 1 + (random_key(n + i) >> 24), i);
+    }
+    Result r = t.stop(n);
+    sink = fired;
+    return r;
+}
+
+template <typename C>
+static Result queue_drain(u64 n) {
+    C c;
+    fill_deadlines(c, n);
+    u64 fired = 0;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; ++i) {
+        fired += c.pop_min();
+    }
+    Result r = t.stop(n);
+    sink = fired;
+    return r;
+}
+
+// insert_batch:
+// n new keys into a tree of n, handed over in unsorted batches of batch_size
+static constexpr u64 batch_size = 10000;
+
+template <typename C>
+static Result insert_batch(u64 n) {
+    C c;
+    fill_random(c, n);
+    std::vector<std::pair<u64, u64>> batch;
+    batch.reserve(batch_size);
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; i += batch_size) {
+        batch.clear();
+        for (u64 j = i; j < n && j < i + batch_size; ++j) {
+            batch.push_back({random_key(n + j), j});
+        }
+        c.batch(batch);
+    }
+    return t.stop(n);
+}
+
+// range_scan:
+// windows of about 100 keys, reported per visited entry
+template <typename C>
+static Result range_scan(u64 n) {
+    C c;
+    for (u64 i = 0; i < n; ++i) {
+        c.insert(i * 2, i);
+    }
+    if constexpr (has_seal<C>::value) {
+        c.seal();
+    }
+    u64 scans = std::max<u64>(1, n / 100);
+    u64 visited = 0;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < scans; ++i) {
+        u64 lo = (mix(i) % n) * 2;
+        c.scan(lo, lo + 200, [&](u64, u64 v) { visited += v; });
+    }
+    Result r = t.stop(scans * 100);
+    sink = visited;
+    return r;
+}
+
+template <typename C>
+static Result bulk_load(u64 n) {
+    std::vector<std::pair<u64, u64>> sorted(n);
+    for (u64 i = 0; i < n; ++i) {
+        sorted[i] = {i * 2, i};
+    }
+    C c;
+    Timer t;
+    t.start();
+    c.bulk(sorted);
+    return t.stop(n);
+}
+
+// clone:
+// a deep copy of a tree of n, on threads threads where the container can
+template <typename C, unsigned threads>
+static Result clone(u64 n) {
+    C c;
+    fill_random(c, n);
+    Timer t;
+    t.start();
+    C copy = c.clone(threads);
+    Result r = t.stop(n);
+    sink = copy.find(random_key(0));
+    return r;
+}
+
+// set algebra:
+// two containers of n random keys each, the second starting halfway
+// through the keys of the first, so half of them are shared. The
+// union_with, intersect_with and difference_with cases run the join based
+// algorithms (on threads threads), the *_loop cases reach the same result
+// one key at a time with find, insert and erase.
+static u64 other_key(u64 i, u64 n) {
+    return random_key(i + n / 2);
+}
+
+template <typename C>
+static void fill_both(C& a, C& b, u64 n) {
+    for (u64 i = 0; i < n; ++i) {
+        a.insert(random_key(i), i);
+        b.insert(other_key(i, n), i);
+    }
+}
+
+template <typename C, unsigned threads>
+static Result union_with(u64 n) {
+    C a, b;
+    fill_both(a, b, n);
+    Timer t;
+    t.start();
+    a.union_with(b, threads);
+    Result r = t.stop(n);
+    sink = a.find(other_key(0, n));
+    return r;
+}
+
+template <typename C, unsigned threads>
+static Result intersect_with(u64 n) {
+    C a, b;
+    fill_both(a, b, n);
+    Timer t;
+    t.start();
+    a.intersect_with(b, threads);
+    Result r = t.stop(n);
+    sink = a.find(other_key(0, n));
+    return r;
+}
+
+template <typename C, unsigned threads>
+static Result difference_with(u64 n) {
+    C a, b;
+    fill_both(a, b, n);
+    Timer t;
+    t.start();
+    a.difference_with(b, threads);
+    Result r = t.stop(n);
+    sink = a.find(random_key(0));
+    return r;
+}
+
+template <typename C>
+static Result union_loop(u64 n) {
+    C a, b;
+    fill_both(a, b, n);
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; ++i) {
+        u64 k = other_key(i, n);
+        if (!a.find(k)) {
+            a.insert(k, i);
+        }
+    }
+    Result r = t.stop(n);
+    sink = a.find(other_key(0, n));
+    return r;
+}
+
+template <typename C>
+static Result intersect_loop(u64 n) {
+    C a, b;
+    fill_both(a, b, n);
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; ++i) {
+        u64 k = random_key(i);
+        if (!b.find(k)) {
+            a.erase(k);
+        }
+    }
+    Result r = t.stop(n);
+    sink = a.find(other_key(0, n));
+    return r;
+}
+
+template <typename C>
+static Result difference_loop(u64 n) {
+    C a, b;
+    fill_both(a, b, n);
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < n; ++i) {
+        a.erase(other_key(i, n));
+    }
+    Result r = t.stop(n);
+    sink = a.find(random_key(0));
+    return r;
+}
+
+template <typename C>
+static Result teardown(u64 n) {
+    std::unique_ptr<C> c(new C());
+    fill_random(*c, n);
+    Timer t;
+    t.start();
+    c.reset();
+    return t.stop(n);
+}
+
+// concurrent_lookup:
+// readers threads do n hits each while one writer keeps overwriting keys.
+// ns/op is wall time over all lookups, so flat across reader counts means
+// linear scaling. Cache misses only count the calling thread.
+template <typename C, int readers>
+static Result concurrent_lookup(u64 n) {
+    C c;
+    fill_random(c, n);
+
+    std::atomic<bool> stop{false};
+    std::thread writer([&] {
+        for (u64 i = 0; !stop.load(std::memory_order_relaxed); ++i) {
+            c.insert(random_key(mix(i) % n), i);
+        }
+    });
+
+    std::atomic<u64> found{0};
+    std::vector<std::thread> pool;
+    Timer t;
+    t.start();
+    for (int r = 0; r < readers; ++r) {
+        pool.emplace_back([&c, &found, n, r] {
+            u64 local = 0;
+            for (u64 i = 0; i < n; ++i) {
+                local += c.find(random_key(mix(i + u64(r) * n) % n));
+            }
+            found += local;
+        });
+    }
+    for (std::thread& p : pool) {
+        p.join();
+    }
+    Result result = t.stop(n * readers);
+
+    stop = true;
+    writer.join();
+    sink = found;
+    return result;
+}
+
+// concurrent_insert:
+// writers threads insert n distinct keys between them into an empty
+// container. ns/op is wall time over all inserts, so halving as writers
+// double means linear scaling (up to the number of cores).
+template <typename C, int writers>
+static Result concurrent_insert(u64 n) {
+    C c;
+    std::vector<std::thread> pool;
+    Timer t;
+    t.start();
+    for (int w = 0; w < writers; ++w) {
+        pool.emplace_back([&c, n, w] {
+            for (u64 i = u64(w); i < n; i += writers) {
+                c.insert(random_key(i), i);
+            }
+        });
+    }
+    for (std::thread& p : pool) {
+        p.join();
+    }
+    Result result = t.stop(n);
+    sink = c.find(random_key(n / 2));
+    return result;
+}
+
+// interval_span:
+// n intervals of up to 2000 units spread over 1000 n units, so a point
+// is covered by about one interval and a 1000 unit query meets about two
+static u64 interval_span(u64 n) {
+    return n * 1000;
+}
+
+template <typename C>
+static void fill_intervals(C& c, u64 n) {
+    u64 span = interval_span(n);
+    for (u64 i = 0; i < n; ++i) {
+        u64 start = mix(i) % span;
+        c.insert(start, start + 1 + mix(i ^ 0x9e3779b97f4a7c15ULL) % 2000);
+    }
+}
+
+// overlap_any:
+// conflict check, is any interval meeting [lo, lo + 1000)
+template <typename C>
+static Result overlap_any(u64 n) {
+    C c;
+    fill_intervals(c, n);
+    u64 span = interval_span(n);
+    u64 queries = std::min(n, C::max_queries);
+    u64 found = 0;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < queries; ++i) {
+        u64 lo = mix(i + n) % span;
+        found += c.any(lo, lo + 1000);
+    }
+    Result r = t.stop(queries);
+    sink = found;
+    return r;
+}
+
+// overlap_all:
+// every interval meeting [lo, lo + 1000), reported per query
+template <typename C>
+static Result overlap_all(u64 n) {
+    C c;
+    fill_intervals(c, n);
+    u64 span = interval_span(n);
+    u64 queries = std::min(n, C::max_queries);
+    u64 found = 0;
+    Timer t;
+    t.start();
+    for (u64 i = 0; i < queries; ++i) {
+        u64 lo = mix(i + n) % span;
+        c.all(lo, lo + 1000, [&](u64, u64 end) { found += end; });
+    }
+    Result r = t.stop(queries);
+    sink = found;
+    return r;
+}
+
+
+// DRIVER ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+struct Case {
+    std::string name;
+    Result (*run)(u64);
+};
+
+template <typename C>
+static void add_cases(std::vector<Case>& cases) {
+    std::string c = C::name;
+    cases.push_back({"insert_random/" + c, insert_random<C>});
+    cases.push_back({"insert_sequential/" + c, insert_sequential<C>});
+    cases.push_back({"insert_nearly_sorted/" + c, insert_nearly_sorted<C>});
+    cases.push_back({"insert_zipf/" + c, insert_zipf<C>});
+    cases.push_back({"lookup_hit/" + c, lookup_hit<C>});
+    cases.push_back({"lookup_miss/" + c, lookup_miss<C>});
+    cases.push_back({"mixed/" + c, mixed<C>});
+    cases.push_back({"insert_batch/" + c, insert_batch<C>});
+    cases.push_back({"range_scan/" + c, range_scan<C>});
+    cases.push_back({"bulk_load/" + c, bulk_load<C>});
+    cases.push_back({"teardown/" + c, teardown<C>});
+}
+
+template <typename C>
+static void add_concurrent_cases(std::vector<Case>& cases) {
+    std::string c = C::name;
+    cases.push_back({"concurrent_lookup_r1/" + c, concurrent_lookup<C, 1>});
+    cases.push_back({"concurrent_lookup_r4/" + c, concurrent_lookup<C, 4>});
+    cases.push_back({"concurrent_lookup_r32/" + c, concurrent_lookup<C, 32>});
+}
+
+template <typename C>
+static void add_erase_cases(std::vector<Case>& cases) {
+    std::string c = C::name;
+    cases.push_back({"mixed_erase/" + c, mixed_erase<C>});
+    cases.push_back({"window_remove/" + c, window_remove<C>});
+    cases.push_back({"window_expire/" + c, window_expire<C>});
+}
+
+template <typename C>
+static void add_batch_lookup_cases(std::vector<Case>& cases) {
+    std::string c = C::name;
+    cases.push_back({"lookup_loop/" + c, lookup_loop<C>});
+    cases.push_back({"lookup_batch/" + c, lookup_batch<C>});
+}
+
+template <typename C>
+static void add_set_cases(std::vector<Case>& cases) {
+    std::string c = C::name;
+    cases.push_back({"insert_random/" + c, insert_random<C>});
+    cases.push_back({"lookup_hit/" + c, lookup_hit<C>});
+    cases.push_back({"lookup_miss/" + c, lookup_miss<C>});
+    cases.push_back({"teardown/" + c, teardown<C>});
+}
+
+template <typename C>
+static void add_algebra_cases(std::vector<Case>& cases) {
+    std::string c = C::name;
+    cases.push_back({"union/" + c, union_with<C, 1>});
+    cases.push_back({"union_t4/" + c, union_with<C, 4>});
+    cases.push_back({"intersect/" + c, intersect_with<C, 1>});
+    cases.push_back({"intersect_t4/" + c, intersect_with<C, 4>});
+    cases.push_back({"difference/" + c, difference_with<C, 1>});
+    cases.push_back({"difference_t4/" + c, difference_with<C, 4>});
+}
+
+template <typename C>
+static void add_algebra_loop_cases(std::vector<Case>& cases) {
+    std::string c = C::name;
+    cases.push_back({"union_loop/" + c, union_loop<C>});
+    cases.push_back({"intersect_loop/" + c, intersect_loop<C>});
+    cases.push_back({"difference_loop/" + c, difference_loop<C>});
+}
+
+template <typename C>
+static void add_queue_cases(std::vector<Case>& cases) {
+    std::string c = C::name;
+    cases.push_back({"queue_hold/" + c, queue_hold<C>});
+    cases.push_back({"queue_drain/" + c, queue_drain<C>});
+}
+
+template <typename C>
+static void add_hint_cases(std::vector<Case>& cases) {
+    std::string c = C::name;
+    cases.push_back({"hinted_sequential/" + c, hinted_sequential<C>});
+    cases.push_back({"hinted_nearly_sorted/" + c, hinted_nearly_sorted<C>});
+    cases.push_back({"hinted_random/" + c, hinted_random<C>});
+}
+
+template <typename C>
+static void add_scaling_cases(std::vector<Case>& cases) {
+    std::string c = C::name;
+    cases.push_back({"concurrent_insert_w1/" + c, concurrent_insert<C, 1>});
+    cases.push_back({"concurrent_insert_w2/" + c, concurrent_insert<C, 2>});
+    cases.push_back({"concurrent_insert_w4/" + c, concurrent_insert<C, 4>});
+    cases.push_back({"concurrent_insert_w8/" + c, concurrent_insert<C, 8>});
+    cases.push_back({"concurrent_insert_w16/" + c, concurrent_insert<C, 16>});
+    cases.push_back({"concurrent_insert_w32/" + c, concurrent_insert<C, 32>});
+    cases.push_back({"concurrent_insert_w64/" + c, concurrent_insert<C, 64>});
+}
+
+template <typename C>
+static void add_lookup_cases(std::vector<Case>& cases) {
+    std::string c = C::name;
+    cases.push_back({"lookup_hit/" + c, lookup_hit<C>});
+    cases.push_back({"lookup_miss/" + c, lookup_miss<C>});
+    cases.push_back({"range_scan/" + c, range_scan<C>});
+}
+
+template <typename C>
+static void add_interval_cases(std::vector<Case>& cases) {
+    std::string c = C::name;
+    cases.push_back({"overlap_any/" + c, overlap_any<C>});
+    cases.push_back({"overlap_all/" + c, overlap_all<C>});
+}
+
+// run_isolated:
+// forks, the child measures and writes the result in the pipe,
+// the parent collects it together with the child's peak RSS
+static bool run_isolated(const Case& c, u64 n, Result& result, long& peak_kb) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        Result r = c.run(n);
+        ssize_t written = write(fds[1], &r, sizeof r);
+        _exit(written == sizeof r ? 0 : 1);
+    }
+    close(fds[1]);
+    bool ok = read(fds[0], &result, sizeof result) == sizeof result;
+    close(fds[0]);
+    int status = 0;
+    rusage usage;
+    wait4(pid, &status, 0, &usage);
+    peak_kb = usage.ru_maxrss;
+    return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, char** argv) {
+    u64 min_n = 1000;
+    u64 max_n = 1000000;
+    std::string filter;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--max") == 0) {
+            max_n = std::strtoull(argv[i + 1], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--min") == 0) {
+            min_n = std::strtoull(argv[i + 1], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--filter") == 0) {
+            filter = argv[i + 1];
+        }
+    }
+
+    std::vector<Case> cases;
+    add_cases<Rb_adapter>(cases);
+    add_cases<Map_adapter>(cases);
+    add_cases<Set_adapter>(cases);
+    add_cases<Btree_adapter>(cases);
+    cases.push_back({"insert_string/rbtree", insert_string<Rb_string_adapter>});
+    cases.push_back({"insert_string/std::map", insert_string<Map_string_adapter>});
+    add_erase_cases<Rb_adapter>(cases);
+    add_erase_cases<Map_adapter>(cases);
+    add_erase_cases<Set_adapter>(cases);
+    cases.push_back({"clone/rbtree", clone<Rb_adapter, 1>});
+    cases.push_back({"clone_t4/rbtree", clone<Rb_adapter, 4>});
+    cases.push_back({"clone/std::map", clone<Map_adapter, 1>});
+    add_algebra_cases<Rb_adapter>(cases);
+    add_algebra_loop_cases<Rb_adapter>(cases);
+    add_algebra_loop_cases<Map_adapter>(cases);
+    add_set_cases<Rb_int_set_adapter>(cases);
+    add_set_cases<Std_int_set_adapter>(cases);
+    add_batch_lookup_cases<Rb_adapter>(cases);
+    cases.push_back({"lookup_loop/std::map", lookup_loop<Map_adapter>});
+    add_queue_cases<Rb_adapter>(cases);
+    add_queue_cases<Map_adapter>(cases);
+    add_queue_cases<Heap_adapter>(cases);
+    add_hint_cases<Rb_adapter>(cases);
+    add_hint_cases<Map_adapter>(cases);
+    add_lookup_cases<Frozen_adapter>(cases);
+    add_concurrent_cases<Cow_adapter>(cases);
+    add_concurrent_cases<Locked_adapter>(cases);
+    add_concurrent_cases<Sharded_adapter>(cases);
+    add_scaling_cases<Locked_adapter>(cases);
+    add_scaling_cases<Cow_adapter>(cases);
+    add_scaling_cases<Sharded_adapter>(cases);
+    add_scaling_cases<Range_sharded_adapter>(cases);
+    add_interval_cases<Interval_adapter>(cases);
+    add_interval_cases<Scan_adapter>(cases);
+
+    std::printf("%-40s %12s %12s %14s %16s %14s\n", "case", "n", "ns/op", "peak RSS MB", "cache miss/op",
+                "compares/op");
+    for (const Case& c : cases) {
+        if (!filter.empty() && c.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        for (u64 n = min_n; n <= max_n; n *= 10) {
+            Result r;
+            long peak_kb = 0;
+            if (!run_isolated(c, n, r, peak_kb)) {
+                std::printf("%-40s %12llu %12s\n", c.name.c_str(), (unsigned long long) n, "failed");
+                continue;
+            }
+            char misses[32] = "n/a";
+            if (r.misses_per_op >= 0) {
+                std::snprintf(misses, sizeof misses, "%.2f", r.misses_per_op);
+            }
+            char compares[32] = "";
+            if (r.comparisons_per_op >= 0) {
+                std::snprintf(compares, sizeof compares, "%.2f", r.comparisons_per_op);
+            }
+            std::printf("%-40s %12llu %12.1f %14.1f %16s %14s\n", c.name.c_str(), (unsigned long long) n,
+                        r.ns_per_op, peak_kb / 1024.0, misses, compares);
+            std::fflush(stdout);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,1530 @@
+// RBTree test suite.
+// Self-contained like benchmark.cpp, no dependency besides the library.
+//
+// Build:  g++ -std=c++17 -O1 -pthread -fsanitize=address,undefined test.cpp -o test
+// Usage:  ./test [filter]
+//   filter : only run the tests whose name contains it
+//
+// Every structure runs seeded random operations next to a std::map or
+// std::set and is compared with it (and validate()d, where it can) after
+// each batch. Exits with 1 when a check failed.
+
+#include "RBTree.h"
+#include "ConcurrentRBTree.h"
+#include "FrozenIndex.h"
+#include "MappedSnapshot.h"
+#include "PersistentRBTree.h"
+#include "ShardedRBTree.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// HARNESS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static int failures = 0;
+
+// check:
+// reports a failed condition, the test keeps going
+static void check(bool ok, const char* what, const char* file, int line) {
+    if (!ok) {
+        ++failures;
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+    }
+}
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+using Rng = std::mt19937_64;
+
+// pick: uniform in [0, n)
+static int pick(Rng& rng, int n) {
+    return static_cast<int>(rng() % static_cast<std::uint64_t>(n));
+}
+
+// key range of the random operations, small enough for many repeats
+static constexpr int key_range = 4000;
+static constexpr int batches = 20;
+static constexpr int batch_ops = 500;
+
+// same:
+// whether a tree holds exactly the entries of a std::map, in order
+template <typename Tree, typename M> static bool same(const Tree& t, const M& m) {
+    auto it = m.begin();
+    for (const auto& e : t) {
+        if (it == m.end() || e.key != it->first || !(e.val == it->second)) {
+            return false;
+        }
+        ++it;
+    }
+    return it == m.end();
+}
+
+// collect:
+// the entries a for_each style walk reports
+template <typename K, typename V> struct Collect {
+    std::vector<std::pair<K, V>>* out;
+    void operator()(const K& k, const V& v) const { out->emplace_back(k, v); }
+};
+
+template <typename M> static std::vector<std::pair<int, int>> entries(const M& m, int lo, int hi) {
+    return {m.lower_bound(lo), m.lower_bound(hi)};
+}
+
+template <typename M> static std::vector<std::pair<int, int>> entries(const M& m) {
+    return {m.begin(), m.end()};
+}
+
+// random_map: n random entries
+static std::map<int, int> random_map(Rng& rng, int n, int range = key_range) {
+    std::map<int, int> m;
+    while (static_cast<int>(m.size()) < n && static_cast<int>(m.size()) < range) {
+        m[pick(rng, range)] = pick(rng, 1000);
+    }
+    return m;
+}
+
+template <typename Tree> static Tree tree_of(const std::map<int, int>& m) {
+    Tree t;
+    for (const auto& e : m) {
+        t.insert(e.first, e.second);
+    }
+    return t;
+}
+
+// same_keys: as same, for sets
+template <typename Tree, typename S> static bool same_keys(const Tree& t, const S& s) {
+    return std::equal(t.begin(), t.end(), s.begin(), s.end(),
+                      [](const auto& e, const auto& k) { return e.key == k; });
+}
+
+// Tracked: counts its live instances, owned as a raw pointer
+struct Tracked {
+    static int live;
+    int id;
+    explicit Tracked(int i) : id(i) { ++live; }
+    ~Tracked() { --live; }
+};
+
+int Tracked::live = 0;
+
+struct By_id {
+    bool operator()(const Tracked* a, const Tracked* b) const { return a->id < b->id; }
+};
+
+using Tree = Red_black_tree<int, int>;
+
+// ALLOCATION ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Counting_resource:
+// upstream resource that counts its calls and the bytes it has out
+struct Counting_resource : std::pmr::memory_resource {
+    std::size_t bytes = 0;
+    std::size_t calls = 0;
+
+    void* do_allocate(std::size_t n, std::size_t align) override {
+        bytes += n;
+        ++calls;
+        return std::pmr::new_delete_resource()->allocate(n, align);
+    }
+    void do_deallocate(void* p, std::size_t n, std::size_t align) override {
+        bytes -= n;
+        std::pmr::new_delete_resource()->deallocate(p, n, align);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
+
+// nodes come from the resource in blocks, removed ones are reused, and
+// clear() and the destructor hand every block back
+static void test_arena() {
+    Counting_resource upstream;
+    {
+        Tree t(&upstream);
+        for (int k = 0; k < 10000; ++k) {
+            t.insert(k, k);
+        }
+        std::size_t calls = upstream.calls;
+        CHECK(calls < 20);
+        for (int k = 0; k < 10000; k += 2) {
+            CHECK(t.remove(k));
+        }
+        for (int k = 0; k < 10000; k += 2) {
+            t.insert(k, -k);
+        }
+        CHECK(upstream.calls == calls);
+        CHECK(t.validate());
+        t.clear();
+        CHECK(upstream.bytes == 0 && t.begin() == t.end());
+        t.insert(1, 1);
+        CHECK(upstream.bytes > 0 && t.validate());
+    }
+    CHECK(upstream.bytes == 0);
+}
+
+// INSERT ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// random inserts, overwrites included, then increasing and decreasing runs
+static void test_insert() {
+    Rng rng(1);
+    Tree t;
+    std::map<int, int> m;
+    for (int b = 0; b < batches; ++b) {
+        for (int i = 0; i < batch_ops; ++i) {
+            int k = pick(rng, key_range);
+            int v = pick(rng, 1000);
+            t.insert(k, v);
+            m[k] = v;
+        }
+        CHECK(t.validate());
+        CHECK(same(t, m));
+        CHECK(t.height() <= 2 * std::log2(m.size() + 1));
+        for (int i = 0; i < 100; ++i) {
+            int k = pick(rng, key_range);
+            const int* v = t.find(k);
+            auto mt = m.find(k);
+            CHECK(mt == m.end() ? v == nullptr : v && *v == mt->second);
+            CHECK(t.contains(k) == (mt != m.end()));
+        }
+    }
+
+    Tree up;
+    Tree down;
+    for (int k = 0; k < 20000; ++k) {
+        up.insert(k, k);
+        down.insert(-k, k);
+    }
+    CHECK(up.validate() && down.validate());
+    CHECK(up.height() <= 2 * std::log2(20001.0) && down.height() <= 2 * std::log2(20001.0));
+    CHECK(up.min_key() == 0 && up.max_key() == 19999 && down.min_key() == -19999);
+}
+
+// ITERATORS AND RANGES ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// in order walks both ways, bounds, neighbours and range scans
+static void test_iterators() {
+    Rng rng(3);
+    for (int n : {0, 1, 2, 100, 3000}) {
+        std::map<int, int> m = random_map(rng, n);
+        Tree t = tree_of<Tree>(m);
+        const Tree& c = t;
+        CHECK(std::distance(c.begin(), c.end()) == static_cast<std::ptrdiff_t>(m.size()));
+        auto mt = m.rbegin();
+        for (auto it = t.end(); it != t.begin() && mt != m.rend(); ++mt) {
+            --it;
+            CHECK(it->key == mt->first);
+        }
+        CHECK(mt == m.rend());
+
+        for (int i = 0; i < 200; ++i) {
+            int k = pick(rng, key_range + 2) - 1;
+            auto lb = t.lower_bound(k);
+            auto ub = c.upper_bound(k);
+            auto mlb = m.lower_bound(k);
+            auto mub = m.upper_bound(k);
+            CHECK(mlb == m.end() ? lb == t.end() : lb->key == mlb->first);
+            CHECK(mub == m.end() ? ub == c.end() : ub->key == mub->first);
+            auto range = t.equal_range(k);
+            CHECK(std::distance(range.first, range.second) == static_cast<std::ptrdiff_t>(m.count(k)));
+            auto nx = t.next(k);
+            CHECK(mub == m.end() ? nx == t.end() : nx->key == mub->first);
+            auto pv = t.previous(k);
+            CHECK(mlb == m.begin() ? pv == t.end() : pv->key == std::prev(mlb)->first);
+
+            std::vector<std::pair<int, int>> got;
+            t.for_each_in_range(k, k + 300, Collect<int, int>{&got});
+            CHECK(got == entries(m, k, k + 300));
+        }
+
+        // values are writable through mutable iterators
+        if (n > 0) {
+            t.begin()->val = -7;
+            Tree::const_iterator first = t.begin();
+            CHECK(first->val == -7 && *t.find(m.begin()->first) == -7);
+        }
+    }
+}
+
+// BULK LOADING ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// from_sorted and assign_sorted, on one and on four threads
+static void test_from_sorted() {
+    Rng rng(6);
+    for (int n : {0, 1, 2, 3, 7, 100, 1000, 33333}) {
+        std::map<int, int> m = random_map(rng, n, 100000);
+        std::vector<std::pair<int, int>> v(m.begin(), m.end());
+        for (unsigned threads : {1u, 4u}) {
+            Tree t = Tree::from_sorted(v.begin(), v.end(), threads);
+            CHECK(t.validate());
+            CHECK(same(t, m));
+            Tree u;
+            u.insert(-1, -1);
+            u.assign_sorted(v.begin(), v.end(), threads);
+            CHECK(u.validate());
+            CHECK(same(u, m));
+        }
+    }
+}
+
+// JOIN, SPLIT AND SET ALGEBRA ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// split at random keys, check both halves, join them back
+static void test_join_split() {
+    Rng rng(7);
+    for (int round = 0; round < 200; ++round) {
+        std::map<int, int> m = random_map(rng, pick(rng, 2000));
+        Tree t = tree_of<Tree>(m);
+        int k = pick(rng, key_range + 2) - 1;
+        Tree greater;
+        greater.insert(-5, -5); // emptied by split
+        t.split(k, greater);
+        CHECK(t.validate() && greater.validate());
+        CHECK(same(t, std::map<int, int>(m.begin(), m.upper_bound(k))));
+        CHECK(same(greater, std::map<int, int>(m.upper_bound(k), m.end())));
+
+        // both share an arena now, keep writing to them
+        t.insert(std::min(k, -1), 1);
+        greater.insert(key_range + 1, 2);
+        m[std::min(k, -1)] = 1;
+        m[key_range + 1] = 2;
+        t.join(greater);
+        CHECK(t.validate() && greater.validate());
+        CHECK(greater.begin() == greater.end());
+        CHECK(same(t, m));
+    }
+}
+
+// union, intersection and difference against the std algorithms
+static void test_set_algebra() {
+    Rng rng(8);
+    for (unsigned threads : {1u, 2u, 4u}) {
+        for (int round = 0; round < 30; ++round) {
+            int range = pick(rng, 2) ? 5000 : 200000;
+            std::map<int, int> a = random_map(rng, pick(rng, 20000), range);
+            std::map<int, int> b = random_map(rng, pick(rng, round % 3 ? 20000 : 50), range);
+            for (auto& e : b) {
+                e.second += 1000; // tells the sides apart
+            }
+            std::vector<std::pair<int, int>> ea(a.begin(), a.end());
+            std::vector<std::pair<int, int>> eb(b.begin(), b.end());
+            auto by_key = [](const std::pair<int, int>& x, const std::pair<int, int>& y) { return x.first < y.first; };
+
+            std::map<int, int> expected;
+            std::set_union(ea.begin(), ea.end(), eb.begin(), eb.end(), std::inserter(expected, expected.end()), by_key);
+            Tree t = Tree::from_sorted(ea.begin(), ea.end());
+            Tree u = Tree::from_sorted(eb.begin(), eb.end());
+            t.union_with(u, threads);
+            CHECK(t.validate() && u.validate() && u.begin() == u.end());
+            CHECK(same(t, expected));
+
+            expected.clear();
+            std::set_intersection(ea.begin(), ea.end(), eb.begin(), eb.end(), std::inserter(expected, expected.end()), by_key);
+            t = Tree::from_sorted(ea.begin(), ea.end());
+            u = Tree::from_sorted(eb.begin(), eb.end());
+            t.intersect_with(u, threads);
+            CHECK(t.validate() && u.validate() && u.begin() == u.end());
+            CHECK(same(t, expected));
+
+            expected.clear();
+            std::set_difference(ea.begin(), ea.end(), eb.begin(), eb.end(), std::inserter(expected, expected.end()), by_key);
+            t = Tree::from_sorted(ea.begin(), ea.end());
+            u = Tree::from_sorted(eb.begin(), eb.end());
+            t.difference_with(u, threads);
+            CHECK(t.validate() && u.validate() && u.begin() == u.end());
+            CHECK(same(t, expected));
+
+            // the consumed tree stays usable
+            u.insert(1, 1);
+            CHECK(u.validate() && u.contains(1));
+        }
+    }
+}
+
+// trees that exchanged nodes share blocks, not free lists: the halves of
+// a split and the two sides of a union are modified on two threads at once
+static void test_shared_blocks() {
+    auto churn = [](Tree& t, std::map<int, int>& m, std::uint64_t seed) {
+        Rng rng(seed);
+        for (int i = 0; i < 20000; ++i) {
+            int k = pick(rng, 100000);
+            if (pick(rng, 2)) {
+                t.insert(k, i);
+                m[k] = i;
+            } else {
+                t.remove(k);
+                m.erase(k);
+            }
+        }
+    };
+    Rng rng(5);
+    for (int round = 0; round < 4; ++round) {
+        std::map<int, int> ma = random_map(rng, 20000, 100000);
+        Tree a = tree_of<Tree>(ma);
+        Tree b;
+        a.split(50000, b);
+        std::map<int, int> mb(ma.upper_bound(50000), ma.end());
+        ma.erase(ma.upper_bound(50000), ma.end());
+        if (round % 2) {
+            Tree c = tree_of<Tree>(mb);
+            b.union_with(c);
+            c.insert(200000, 1); // emptied, c keeps an arena sharing blocks with b
+            a.join(c);
+            ma[200000] = 1;
+        }
+        std::thread other(churn, std::ref(b), std::ref(mb), round);
+        churn(a, ma, round + 100);
+        other.join();
+        CHECK(a.validate() && same(a, ma));
+        CHECK(b.validate() && same(b, mb));
+    }
+}
+
+// LOOKUPS AND EMPLACE ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// emplace and try_emplace keep what is there, emplace_hint places by hint
+static void test_emplace() {
+    Rng rng(2);
+    Tree t;
+    std::map<int, int> m;
+    for (int i = 0; i < batches * batch_ops; ++i) {
+        int k = pick(rng, key_range);
+        int v = pick(rng, 1000);
+        switch (pick(rng, 3)) {
+        case 0: {
+            auto r = t.emplace(k, v);
+            auto mr = m.emplace(k, v);
+            CHECK(r.second == mr.second && r.first->val == mr.first->second);
+            break;
+        }
+        case 1: {
+            auto r = t.try_emplace(k, v);
+            auto mr = m.try_emplace(k, v);
+            CHECK(r.second == mr.second && r.first->val == mr.first->second);
+            break;
+        }
+        default: {
+            auto it = t.emplace_hint(t.upper_bound(k), k, v);
+            auto mit = m.emplace_hint(m.upper_bound(k), k, v);
+            CHECK(it->key == mit->first && it->val == mit->second);
+            break;
+        }
+        }
+    }
+    CHECK(t.validate());
+    CHECK(same(t, m));
+}
+
+// lookups through a transparent comparator, move inserts and move only values
+static void test_lookups() {
+    Red_black_tree<std::string, int, std::less<>> names;
+    std::string alpha = "alpha";
+    names.insert(std::move(alpha), 1);
+    names.insert(std::string("beta"), 2);
+    const int* beta = names.find(std::string_view("beta"));
+    CHECK(beta && *beta == 2);
+    CHECK(names.contains("alpha") && !names.contains(std::string_view("gamma")));
+    CHECK(names.lower_bound(std::string_view("b"))->key == "beta");
+    CHECK(names.upper_bound(std::string_view("beta")) == names.end());
+    CHECK(names.validate());
+
+    Red_black_tree<int, std::unique_ptr<int>> boxes;
+    for (int k = 0; k < 100; ++k) {
+        boxes.emplace(k, std::make_unique<int>(k));
+    }
+    CHECK(!boxes.try_emplace(7, std::make_unique<int>(-1)).second);
+    CHECK(boxes.emplace(100, std::make_unique<int>(100)).second);
+    boxes.insert(5, std::make_unique<int>(-5));
+    CHECK(**boxes.find(7) == 7 && **boxes.find(100) == 100 && **boxes.find(5) == -5);
+    CHECK(boxes.validate());
+}
+
+// CONCURRENT TREE ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static void test_concurrent() {
+    Rng rng(15);
+    Concurrent_red_black_tree<int, int> t;
+    std::map<int, int> m;
+    for (int b = 0; b < batches; ++b) {
+        for (int i = 0; i < batch_ops; ++i) {
+            int k = pick(rng, key_range);
+            if (pick(rng, 3)) {
+                t.insert(k, i);
+                m[k] = i;
+            } else {
+                CHECK(t.remove(k) == (m.erase(k) == 1));
+            }
+        }
+        std::vector<std::pair<int, int>> got;
+        t.read([&](const auto& snapshot) { snapshot.for_each(Collect<int, int>{&got}); });
+        CHECK(got == entries(m));
+        for (int i = 0; i < 100; ++i) {
+            int k = pick(rng, key_range);
+            auto v = t.find(k);
+            auto mt = m.find(k);
+            CHECK(mt == m.end() ? !v : v && *v == mt->second);
+            CHECK(t.contains(k) == (mt != m.end()));
+            got.clear();
+            t.read([&](const auto& snapshot) { snapshot.for_each_in_range(k, k + 100, Collect<int, int>{&got}); });
+            CHECK(got == entries(m, k, k + 100));
+        }
+    }
+
+    // readers always see sorted versions while two writers insert
+    Concurrent_red_black_tree<int, int> shared;
+    std::atomic<bool> done{false};
+    std::atomic<int> bad{0};
+    std::thread reader([&] {
+        while (!done.load()) {
+            shared.read([&](const auto& snapshot) {
+                int last = -1;
+                snapshot.for_each([&](int k, int v) {
+                    bad += k <= last || v != k;
+                    last = k;
+                });
+            });
+        }
+    });
+    std::vector<std::thread> writers;
+    for (int w = 0; w < 2; ++w) {
+        writers.emplace_back([&shared, w] {
+            for (int k = w; k < 20000; k += 2) {
+                shared.insert(k, k);
+                if (k % 7 == 0) {
+                    shared.remove(k);
+                }
+            }
+        });
+    }
+    for (auto& w : writers) {
+        w.join();
+    }
+    done = true;
+    reader.join();
+    CHECK(bad == 0);
+    std::size_t n = 0;
+    shared.read([&](const auto& snapshot) { snapshot.for_each([&](int, int) { ++n; }); });
+    CHECK(n == 20000 - (20000 + 6) / 7);
+
+    // more readers than reader slots: the ones left out wait their turn
+    std::atomic<int> misses{0};
+    std::vector<std::thread> crowd;
+    for (int r = 0; r < 200; ++r) {
+        crowd.emplace_back([&shared, &misses, r] {
+            for (int i = 0; i < 20; ++i) {
+                int k = (r * 20 + i) * 13 % 20000;
+                shared.read([&](const auto& snapshot) {
+                    std::this_thread::yield();
+                    misses += (k % 7 == 0) != (snapshot.find(k) == nullptr);
+                });
+            }
+        });
+    }
+    for (auto& r : crowd) {
+        r.join();
+    }
+    CHECK(misses == 0);
+}
+
+// PERSISTENT TREE ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// every snapshot keeps the content it had when taken
+static void test_persistent() {
+    Rng rng(16);
+    Persistent_red_black_tree<int, int> t;
+    std::map<int, int> m;
+    std::vector<std::pair<Persistent_red_black_tree<int, int>, std::map<int, int>>> versions;
+    for (int b = 0; b < batches; ++b) {
+        for (int i = 0; i < batch_ops; ++i) {
+            int k = pick(rng, key_range);
+            if (pick(rng, 3)) {
+                t.insert(k, i);
+                m[k] = i;
+            } else {
+                CHECK(t.remove(k) == (m.erase(k) == 1));
+            }
+        }
+        CHECK(t.size() == m.size());
+        versions.emplace_back(t.snapshot(), m);
+        if (b % 7 == 6) {
+            t.clear();
+            m.clear();
+        }
+    }
+    for (const auto& v : versions) {
+        std::vector<std::pair<int, int>> got;
+        v.first.for_each(Collect<int, int>{&got});
+        CHECK(got == entries(v.second));
+        CHECK(v.first.size() == v.second.size());
+        for (int i = 0; i < 50; ++i) {
+            int k = pick(rng, key_range);
+            const int* found = v.first.find(k);
+            auto mt = v.second.find(k);
+            CHECK(mt == v.second.end() ? found == nullptr : found && *found == mt->second);
+            got.clear();
+            v.first.for_each_in_range(k, k + 100, Collect<int, int>{&got});
+            CHECK(got == entries(v.second, k, k + 100));
+        }
+    }
+    // a copy can be written to without touching its source
+    Persistent_red_black_tree<int, int> copy(versions.back().first);
+    copy.insert(-1, -1);
+    CHECK(!versions.back().first.contains(-1) && copy.contains(-1));
+}
+
+// ORDER STATISTICS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// rank, select, count and size after random inserts and removes
+static void test_order_statistics() {
+    using Ranked = Red_black_tree<int, int, std::less<int>, true>;
+    Rng rng(9);
+    Ranked t;
+    std::map<int, int> m;
+    for (int b = 0; b < batches; ++b) {
+        for (int i = 0; i < batch_ops; ++i) {
+            int k = pick(rng, key_range);
+            if (pick(rng, 3)) {
+                t.insert(k, i);
+                m[k] = i;
+            } else {
+                CHECK(t.remove(k) == (m.erase(k) == 1));
+            }
+        }
+        if (b % 4 == 3) {
+            int lo = pick(rng, key_range);
+            Ranked rest;
+            t.split(lo, rest);
+            t.join(rest);
+        }
+        CHECK(t.validate());
+        CHECK(same(t, m));
+        CHECK(t.size() == m.size());
+        std::vector<int> keys;
+        for (const auto& e : m) {
+            keys.push_back(e.first);
+        }
+        for (int i = 0; i < 100; ++i) {
+            int k = pick(rng, key_range);
+            int hi = k + pick(rng, 500);
+            std::size_t r = std::lower_bound(keys.begin(), keys.end(), k) - keys.begin();
+            CHECK(t.rank(k) == r);
+            CHECK(t.count(k, hi) == static_cast<std::size_t>(std::lower_bound(keys.begin(), keys.end(), hi) - keys.begin()) - r);
+            std::size_t s = pick(rng, static_cast<int>(keys.size()) + 2);
+            auto it = t.select(s);
+            CHECK(s >= keys.size() ? it == t.end() : it->key == keys[s]);
+        }
+    }
+}
+
+// AGGREGATES ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// reduce over random ranges, with a sum and with a max
+static void test_aggregates() {
+    using Summed = Red_black_tree<int, long, std::less<int>, false, Value_sum<long>>;
+    using Maxed = Red_black_tree<int, int, std::less<int>, true, Value_max<int>>;
+    Rng rng(10);
+    Summed s;
+    Maxed x;
+    std::map<int, int> m;
+    for (int b = 0; b < batches; ++b) {
+        for (int i = 0; i < batch_ops; ++i) {
+            int k = pick(rng, key_range);
+            int v = pick(rng, 100000);
+            if (pick(rng, 3)) {
+                s.insert(k, v);
+                x.insert(k, v);
+                m[k] = v;
+            } else {
+                s.remove(k);
+                x.remove(k);
+                m.erase(k);
+            }
+        }
+        if (b % 5 == 4) {
+            std::vector<int> out;
+            for (int i = 0; i < 200; ++i) {
+                out.push_back(pick(rng, key_range));
+            }
+            s.erase_batch(out.begin(), out.end());
+            x.erase_batch(out.begin(), out.end());
+            for (int k : out) {
+                m.erase(k);
+            }
+        }
+        CHECK(s.validate() && x.validate());
+        long total = 0;
+        for (const auto& e : m) {
+            total += e.second;
+        }
+        CHECK(s.reduce() == total);
+        for (int i = 0; i < 100; ++i) {
+            int lo = pick(rng, key_range);
+            int hi = lo + pick(rng, 1000);
+            long sum = 0;
+            int most = std::numeric_limits<int>::lowest();
+            for (auto it = m.lower_bound(lo); it != m.lower_bound(hi); ++it) {
+                sum += it->second;
+                most = std::max(most, it->second);
+            }
+            CHECK(s.reduce(lo, hi) == sum);
+            CHECK(x.reduce(lo, hi) == most);
+        }
+    }
+}
+
+// INTERVALS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// interval trees against a scan over every interval
+static void test_intervals() {
+    Rng rng(11);
+    Interval_tree<int, int> t;
+    std::map<int, int> m; // start -> end
+    for (int b = 0; b < batches; ++b) {
+        for (int i = 0; i < batch_ops; ++i) {
+            int lo = pick(rng, key_range);
+            if (pick(rng, 4)) {
+                int hi = lo + 1 + pick(rng, pick(rng, 10) ? 20 : 2000);
+                t.insert(lo, hi);
+                m[lo] = hi;
+            } else {
+                t.remove(lo);
+                m.erase(lo);
+            }
+        }
+        CHECK(t.validate());
+        for (int i = 0; i < 100; ++i) {
+            int lo = pick(rng, key_range);
+            int hi = lo + 1 + pick(rng, 50);
+            std::vector<std::pair<int, int>> expected;
+            for (const auto& e : m) {
+                if (e.first < hi && lo < e.second) {
+                    expected.push_back(e);
+                }
+            }
+            std::vector<std::pair<int, int>> got;
+            t.for_each_overlap(lo, hi, Collect<int, int>{&got});
+            CHECK(got == expected);
+            auto any = t.find_any_overlap(lo, hi);
+            CHECK(expected.empty() ? any == t.end() : any->key < hi && lo < any->val);
+        }
+    }
+}
+
+// SNAPSHOTS AND TEXT OUTPUT ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// write_snapshot, read back with Mapped_snapshot and from_sorted
+static void test_snapshot() {
+    Rng rng(13);
+    for (int n : {0, 1, 1000, 20000}) {
+        std::map<int, int> m = random_map(rng, n, 1000000);
+        Tree t = tree_of<Tree>(m);
+        char path[] = "/tmp/rbtree_test_XXXXXX";
+        int fd = mkstemp(path);
+        CHECK(fd >= 0);
+        close(fd);
+        {
+            std::ofstream out(path, std::ios::binary);
+            CHECK(t.write_snapshot(out));
+        }
+        Mapped_snapshot<int, int> snap(path);
+        CHECK(snap.is_open());
+        CHECK(snap.size() == m.size());
+        std::vector<std::pair<int, int>> records;
+        for (const auto& r : snap) {
+            records.emplace_back(r.first, r.second);
+        }
+        CHECK(records == entries(m));
+        for (int i = 0; i < 100; ++i) {
+            int k = pick(rng, 1000000);
+            const int* v = snap.find(k);
+            auto mt = m.find(k);
+            CHECK(mt == m.end() ? v == nullptr : v && *v == mt->second);
+            auto lb = snap.lower_bound(k);
+            CHECK(m.lower_bound(k) == m.end() ? lb == snap.end() : lb->first == m.lower_bound(k)->first);
+            std::vector<std::pair<int, int>> got;
+            snap.for_each_in_range(k, k + 5000, Collect<int, int>{&got});
+            CHECK(got == entries(m, k, k + 5000));
+        }
+        Tree back = Tree::from_sorted(snap.begin(), snap.end());
+        CHECK(back.validate() && same(back, m));
+
+        // a file cut short is refused
+        snap.close();
+        if (n > 0) {
+            CHECK(truncate(path, 40) == 0);
+            CHECK(!snap.open(path) && !snap.is_open());
+        }
+        std::remove(path);
+    }
+
+    // padding inside the records is written as zeros
+    using Padded = Red_black_tree<char, std::int64_t>;
+    using Record = Snapshot_record<char, std::int64_t>;
+    static_assert(sizeof(Record) > sizeof(char) + sizeof(std::int64_t), "no padding to check");
+    Padded p;
+    for (int i = 0; i < 3000; ++i) {
+        p.insert(static_cast<char>(i % 100), -i);
+    }
+    std::ostringstream out;
+    CHECK(p.write_snapshot(out));
+    std::string bytes = out.str();
+    Snapshot_header header;
+    std::memcpy(&header, bytes.data(), sizeof header);
+    CHECK(header.count == 100 && bytes.size() == header.records_offset + 100 * sizeof(Record));
+    bool zeros = true;
+    for (std::size_t r = 0; r < header.count; ++r) {
+        const char* record = bytes.data() + header.records_offset + r * sizeof(Record);
+        for (std::size_t i = sizeof(char); i < offsetof(Record, second); ++i) {
+            zeros &= record[i] == 0;
+        }
+    }
+    CHECK(zeros);
+}
+
+// text output: write_to streams what to_string builds
+static void test_text_output() {
+    Tree pairs;
+    for (int k : {2, 1, 3}) {
+        pairs.insert(k, k);
+    }
+    CHECK(pairs.to_string(Tree::PREORDER) == "[(2,2)[(1,1)NILNIL][(3,3)NILNIL]]");
+    CHECK(pairs.to_string(Tree::INORDER) == "[[NIL,(1,1),NIL],(2,2),[NIL,(3,3),NIL]]");
+    CHECK(Tree().to_string(Tree::POSTORDER) == "NIL");
+
+    Rng rng(14);
+    Tree t = tree_of<Tree>(random_map(rng, 2000));
+    for (Tree::order print : {Tree::INORDER, Tree::PREORDER, Tree::POSTORDER}) {
+        std::ostringstream out;
+        t.write_to(out, print);
+        CHECK(out.str() == t.to_string(print));
+    }
+}
+
+// BATCHES ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// insert_batch and erase_batch, on one and on four threads
+static void test_batches() {
+    for (unsigned threads : {1u, 4u}) {
+        Rng rng(4 + threads);
+        Tree t;
+        std::map<int, int> m;
+        for (int b = 0; b < batches; ++b) {
+            std::vector<std::pair<int, int>> in;
+            for (int i = 0, n = pick(rng, 4000); i < n; ++i) {
+                in.emplace_back(pick(rng, 100000), pick(rng, 1000));
+            }
+            std::size_t fresh = 0;
+            for (const auto& p : in) {
+                fresh += m.count(p.first) == 0;
+                m[p.first] = p.second;
+            }
+            CHECK(t.insert_batch(in.begin(), in.end(), threads) == fresh);
+            CHECK(t.validate());
+            CHECK(same(t, m));
+
+            std::vector<int> out;
+            for (int i = 0, n = pick(rng, 1500); i < n; ++i) {
+                out.push_back(pick(rng, 100000));
+            }
+            std::size_t gone = 0;
+            for (int k : out) {
+                gone += m.erase(k);
+            }
+            CHECK(t.erase_batch(out.begin(), out.end(), threads) == gone);
+            CHECK(t.validate());
+            CHECK(same(t, m));
+        }
+    }
+}
+
+// SHAPE ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// height, black_height and average_depth on trees of known shape, and
+// counters that stay at zero unless RBTREE_STATS is defined
+static void test_shape() {
+    CHECK(Tree().height() == 0 && Tree().black_height() == 0 && Tree().average_depth() == 0);
+    for (int depth = 1; depth <= 12; ++depth) {
+        std::vector<std::pair<int, int>> v;
+        for (int k = 0; k < (1 << depth) - 1; ++k) {
+            v.emplace_back(k, k);
+        }
+        Tree t = Tree::from_sorted(v.begin(), v.end());
+        CHECK(t.height() == static_cast<std::size_t>(depth));
+        double visits = 0;
+        for (int d = 1; d <= depth; ++d) {
+            visits += d * static_cast<double>(1 << (d - 1));
+        }
+        CHECK(t.average_depth() == visits / v.size());
+    }
+
+    Rng rng(16);
+    for (int n : {1, 10, 1000, 20000}) {
+        Tree t = tree_of<Tree>(random_map(rng, n, 1000000));
+        CHECK(t.black_height() >= 1 && t.black_height() <= t.height());
+        CHECK(t.height() <= 2 * t.black_height());
+        CHECK(t.average_depth() >= 1 && t.average_depth() <= t.height());
+    }
+
+    CHECK(!Tree_stats::enabled);
+    for (std::uint64_t n : Tree_stats::read()) {
+        CHECK(n == 0);
+    }
+}
+
+// FROZEN INDEX ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static void test_frozen() {
+    Rng rng(14);
+    for (int n : {0, 1, 15, 16, 17, 300, 5000, 70000}) {
+        std::map<int, int> m = random_map(rng, n, 1000000);
+        Tree t = tree_of<Tree>(m);
+        Frozen_index<int, int> f = t.freeze();
+        CHECK(f.size() == m.size());
+        std::vector<std::pair<int, int>> all;
+        f.for_each(Collect<int, int>{&all});
+        CHECK(all == entries(m));
+        std::vector<int> keys;
+        for (const auto& e : m) {
+            keys.push_back(e.first);
+        }
+        for (int i = 0; i < 200; ++i) {
+            int k = pick(rng, 1000000);
+            const int* v = f.find(k);
+            auto mt = m.find(k);
+            CHECK(mt == m.end() ? v == nullptr : v && *v == mt->second);
+            std::size_t lb = f.lower_bound(k);
+            CHECK(lb == static_cast<std::size_t>(std::lower_bound(keys.begin(), keys.end(), k) - keys.begin()));
+            if (lb < f.size()) {
+                CHECK(f.key_at(lb) == keys[lb] && f.value_at(lb) == m[keys[lb]]);
+            }
+            std::vector<std::pair<int, int>> got;
+            f.for_each_in_range(k, k + 20000, Collect<int, int>{&got});
+            CHECK(got == entries(m, k, k + 20000));
+        }
+        Tree back = f.thaw();
+        CHECK(back.validate() && same(back, m));
+        std::vector<std::pair<int, int>> v(m.begin(), m.end());
+        Frozen_index<int, int> g = Frozen_index<int, int>::from_sorted(v.begin(), v.end());
+        CHECK(g.size() == m.size() && (m.empty() || *g.find(m.begin()->first) == m.begin()->second));
+    }
+
+    // the index borrows the pointers the tree owns, which deletes them once
+    // (a thaw() of it does not compile)
+    Red_black_tree<int, int*> owner;
+    for (int k = 0; k < 1000; ++k) {
+        owner.insert(k, new int(k));
+    }
+    {
+        Frozen_index<int, int*> f = owner.freeze();
+        CHECK(f.size() == 1000 && **f.find(999) == 999 && *f.find(7) == *owner.find(7));
+    }
+    CHECK(owner.validate() && **owner.find(999) == 999);
+}
+
+// SHARDED TREE ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+template <typename Sharded> static void check_sharded(Sharded& t, Rng& rng) {
+    std::map<int, int> m;
+    for (int b = 0; b < batches; ++b) {
+        for (int i = 0; i < batch_ops; ++i) {
+            int k = pick(rng, key_range);
+            if (pick(rng, 3)) {
+                t.insert(k, i);
+                m[k] = i;
+            } else {
+                CHECK(t.remove(k) == (m.erase(k) == 1));
+            }
+        }
+        std::vector<std::pair<int, int>> in;
+        for (int i = 0; i < 100; ++i) {
+            in.emplace_back(pick(rng, key_range), -i);
+        }
+        std::size_t fresh = 0;
+        for (const auto& p : in) {
+            fresh += m.count(p.first) == 0;
+            m[p.first] = p.second;
+        }
+        CHECK(t.insert_batch(in.begin(), in.end()) == fresh);
+        CHECK(t.size() == m.size());
+        std::vector<std::pair<int, int>> got;
+        t.for_each(Collect<int, int>{&got});
+        CHECK(got == entries(m));
+        for (int i = 0; i < 50; ++i) {
+            int k = pick(rng, key_range);
+            auto v = t.find(k);
+            auto mt = m.find(k);
+            CHECK(mt == m.end() ? !v : v && *v == mt->second);
+            CHECK(t.shard_of(k) < t.shard_count());
+            got.clear();
+            t.for_each_in_range(k, k + 300, Collect<int, int>{&got});
+            CHECK(got == entries(m, k, k + 300));
+        }
+    }
+
+    // writers on every shard at once
+    std::vector<std::thread> writers;
+    for (int w = 0; w < 4; ++w) {
+        writers.emplace_back([&t, w] {
+            for (int k = key_range + w; k < key_range + 20000; k += 4) {
+                t.insert(k, k);
+            }
+        });
+    }
+    for (auto& w : writers) {
+        w.join();
+    }
+    for (int k = key_range; k < key_range + 20000; ++k) {
+        m[k] = k;
+    }
+    std::vector<std::pair<int, int>> got;
+    t.for_each(Collect<int, int>{&got});
+    CHECK(got == entries(m));
+}
+
+static void test_sharded() {
+    Rng rng(17);
+    Sharded_red_black_tree<int, int> by_hash(8);
+    CHECK(!by_hash.by_range() && by_hash.shard_count() == 8);
+    check_sharded(by_hash, rng);
+    Sharded_red_black_tree<int, int> by_range(std::vector<int>{500, 1000, 2000, 3000, 5000, 10000});
+    CHECK(by_range.by_range() && by_range.shard_count() == 7);
+    check_sharded(by_range, rng);
+
+    // overwrites release the owned values they replace, one by one or batched
+    {
+        Sharded_red_black_tree<int, Tracked*> owned(4);
+        for (int i = 0; i < 5000; ++i) {
+            int k = pick(rng, 300);
+            owned.insert(k, new Tracked(k));
+        }
+        CHECK(static_cast<int>(owned.size()) == Tracked::live);
+        std::vector<std::pair<int, Tracked*>> batch;
+        for (int i = 0; i < 1000; ++i) {
+            int k = pick(rng, 400);
+            batch.emplace_back(k, new Tracked(k));
+        }
+        owned.insert_batch(batch.begin(), batch.end());
+        CHECK(static_cast<int>(owned.size()) == Tracked::live);
+    }
+    CHECK(Tracked::live == 0);
+}
+
+// OWNERSHIP ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// remove, clear and the destructor destroy what the nodes hold
+static void test_teardown() {
+    {
+        Red_black_tree<std::string, std::string> t;
+        for (int k = 0; k < 3000; ++k) {
+            t.insert(std::to_string(k) + std::string(40, 'k'), std::string(40, 'v'));
+        }
+        t.clear();
+        CHECK(t.validate() && t.begin() == t.end());
+        for (int k = 0; k < 3000; ++k) {
+            t.insert(std::to_string(k), std::string(40, 'v'));
+        }
+        CHECK(t.validate());
+    }
+    {
+        Red_black_tree<int, Tracked*> t;
+        for (int k = 0; k < 1000; ++k) {
+            t.insert(k, new Tracked(k));
+        }
+        for (int k = 0; k < 1000; k += 2) {
+            CHECK(t.remove(k));
+        }
+        CHECK(Tracked::live == 500);
+        t.clear();
+        CHECK(Tracked::live == 0);
+        for (int k = 0; k < 1000; ++k) {
+            t.insert(k, new Tracked(k));
+        }
+    }
+    CHECK(Tracked::live == 0);
+}
+
+// every pointer handed to a tree is deleted exactly once (ASan reports the
+// second time), overwritten values and keys equal to stored ones included
+static void test_ownership() {
+    Rng rng(19);
+    {
+        Red_black_tree<int, Tracked*> t;
+        for (int i = 0; i < 5000; ++i) {
+            int k = pick(rng, 300);
+            switch (pick(rng, 4)) {
+            case 0:
+                t.insert(k, new Tracked(k));
+                break;
+            case 1:
+                t.insert(t.lower_bound(k), k, new Tracked(k));
+                break;
+            case 2:
+                if (Tracked** v = t.find(k)) {
+                    t.insert(k, *v); // the same value again is kept
+                }
+                break;
+            default:
+                t.remove(k);
+                break;
+            }
+        }
+        std::vector<std::pair<int, Tracked*>> batch;
+        for (int i = 0; i < 1000; ++i) {
+            int k = pick(rng, 400);
+            Tracked** v = t.find(k);
+            batch.emplace_back(k, v && pick(rng, 2) ? *v : new Tracked(k));
+            if (pick(rng, 4) == 0) {
+                batch.push_back(batch.back()); // repeated pair
+            }
+        }
+        t.insert_batch(batch.begin(), batch.end());
+        CHECK(t.validate());
+        std::size_t n = 0;
+        for (const auto& e : t) {
+            n += e.val->id == e.key;
+        }
+        CHECK(static_cast<int>(n) == Tracked::live);
+    }
+    CHECK(Tracked::live == 0);
+    {
+        Red_black_tree<Tracked*, int, By_id> t;
+        for (int i = 0; i < 5000; ++i) {
+            int k = pick(rng, 300);
+            if (pick(rng, 4)) {
+                t.insert(new Tracked(k), i); // a second key of equal id goes
+            } else {
+                Tracked probe(k);
+                t.remove(&probe);
+            }
+        }
+        std::vector<std::pair<Tracked*, int>> batch;
+        for (int i = 0; i < 1000; ++i) {
+            batch.emplace_back(new Tracked(pick(rng, 400)), i);
+        }
+        t.insert_batch(batch.begin(), batch.end(), 4);
+        CHECK(t.validate());
+        std::size_t n = 0;
+        for (auto it = t.begin(); it != t.end(); ++it) {
+            ++n;
+        }
+        CHECK(static_cast<int>(n) == Tracked::live);
+    }
+    CHECK(Tracked::live == 0);
+}
+
+// HINTED INSERT ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// inserts at end() on nearly sorted keys, and at right, near and wrong hints
+static void test_hinted() {
+    Rng rng(20);
+    Tree t;
+    std::map<int, int> m;
+    for (int k = 0; k < 20000; ++k) {
+        int key = pick(rng, 8) ? k : k - pick(rng, 50);
+        auto it = t.insert(t.end(), key, k);
+        m[key] = k;
+        CHECK(it != t.end() && it->key == key && it->val == k);
+    }
+    CHECK(t.validate() && same(t, m));
+
+    for (int i = 0; i < 20000; ++i) {
+        int k = pick(rng, 40000) - 10000;
+        int v = pick(rng, 1000);
+        Tree::iterator hint;
+        switch (pick(rng, 3)) {
+        case 0:
+            hint = t.lower_bound(k); // right
+            break;
+        case 1:
+            hint = t.upper_bound(k + pick(rng, 10)); // near
+            break;
+        default:
+            hint = t.begin(); // wrong, usually
+            break;
+        }
+        auto it = t.insert(hint, k, v);
+        m[k] = v;
+        CHECK(it->key == k && it->val == v);
+    }
+    CHECK(t.validate() && same(t, m));
+}
+
+// REMOVAL ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// insert, remove, erase and erase_range, mixed at random
+static void test_removal() {
+    Rng rng(1);
+    Tree t;
+    std::map<int, int> m;
+    for (int b = 0; b < batches; ++b) {
+        for (int i = 0; i < batch_ops; ++i) {
+            int k = pick(rng, key_range);
+            int v = pick(rng, 1000);
+            switch (pick(rng, 9)) {
+            case 0: case 1: case 2: case 3:
+                t.insert(k, v);
+                m[k] = v;
+                break;
+            case 4: {
+                auto it = m.lower_bound(k);
+                t.insert(t.lower_bound(k), k, v);
+                m.insert_or_assign(it, k, v);
+                break;
+            }
+            case 5: case 6:
+                CHECK(t.remove(k) == (m.erase(k) == 1));
+                break;
+            case 7: {
+                auto it = t.lower_bound(k);
+                auto mt = m.lower_bound(k);
+                if (mt != m.end()) {
+                    auto next = t.erase(it);
+                    mt = m.erase(mt);
+                    CHECK(mt == m.end() ? next == t.end() : next->key == mt->first);
+                }
+                break;
+            }
+            default: {
+                int hi = k + pick(rng, 20);
+                std::size_t n = std::distance(m.lower_bound(k), m.lower_bound(hi));
+                m.erase(m.lower_bound(k), m.lower_bound(hi));
+                CHECK(t.erase_range(k, hi) == n);
+                break;
+            }
+            }
+        }
+        CHECK(t.validate());
+        CHECK(same(t, m));
+        CHECK(t.height() <= 2 * std::log2(m.size() + 1) + 1);
+        if (!m.empty()) {
+            CHECK(t.min_key() == m.begin()->first && t.max_key() == m.rbegin()->first);
+            CHECK(t.val_at_min() == m.begin()->second && t.val_at_max() == m.rbegin()->second);
+        }
+        for (int i = 0; i < 100; ++i) {
+            int k = pick(rng, key_range);
+            const int* v = t.find(k);
+            auto mt = m.find(k);
+            CHECK(mt == m.end() ? v == nullptr : v && *v == mt->second);
+            auto lb = t.lower_bound(k);
+            auto ub = t.upper_bound(k);
+            CHECK(m.lower_bound(k) == m.end() ? lb == t.end() : lb->key == m.lower_bound(k)->first);
+            CHECK(m.upper_bound(k) == m.end() ? ub == t.end() : ub->key == m.upper_bound(k)->first);
+            auto nx = t.next(k);
+            CHECK(m.upper_bound(k) == m.end() ? nx == t.end() : nx->key == m.upper_bound(k)->first);
+            auto pv = t.previous(k);
+            auto mp = m.lower_bound(k);
+            CHECK(mp == m.begin() ? pv == t.end() : pv->key == std::prev(mp)->first);
+        }
+    }
+    // backwards from end() too
+    auto mt = m.rbegin();
+    for (auto it = t.end(); it != t.begin() && mt != m.rend(); ++mt) {
+        --it;
+        CHECK(it->key == mt->first);
+    }
+    t.clear();
+    CHECK(t.validate() && t.begin() == t.end());
+}
+
+// POP ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// pop_min and pop_max against std::map, down to the empty tree
+static void test_pop() {
+    Rng rng(22);
+    Tree t;
+    std::map<int, int> m;
+    for (int b = 0; b < batches; ++b) {
+        for (int i = 0; i < batch_ops; ++i) {
+            int k = pick(rng, key_range);
+            int v = pick(rng, 1000);
+            if (pick(rng, 3)) {
+                t.insert(k, v);
+                m[k] = v;
+                continue;
+            }
+            bool low = pick(rng, 2);
+            auto got = low ? t.pop_min() : t.pop_max();
+            CHECK(got.has_value() == !m.empty());
+            if (got && !m.empty()) {
+                auto mt = low ? m.begin() : std::prev(m.end());
+                CHECK(got->first == mt->first && got->second == mt->second);
+                m.erase(mt);
+            }
+        }
+        CHECK(t.validate());
+        CHECK(same(t, m));
+        if (!m.empty()) {
+            CHECK(t.min_key() == m.begin()->first && t.max_key() == m.rbegin()->first);
+            CHECK(t.val_at_min() == m.begin()->second && t.val_at_max() == m.rbegin()->second);
+        }
+    }
+    while (auto got = t.pop_min()) {
+        CHECK(got->first == m.begin()->first);
+        m.erase(m.begin());
+    }
+    CHECK(m.empty() && t.validate() && t.begin() == t.end());
+    CHECK(!t.pop_max());
+
+    {
+        // popped entries belong to the caller
+        Red_black_tree<Tracked*, Tracked*, By_id> owned;
+        for (int i = 0; i < 1000; ++i) {
+            int k = pick(rng, 2000);
+            owned.insert(new Tracked(k), new Tracked(k));
+        }
+        while (auto e = pick(rng, 2) ? owned.pop_min() : owned.pop_max()) {
+            CHECK(e->first->id == e->second->id);
+            delete e->first;
+            delete e->second;
+        }
+        CHECK(owned.validate() && Tracked::live == 0);
+    }
+}
+
+// BATCHED LOOKUPS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// find_batch against find, below and above find_width keys at a time
+static void test_find_batch() {
+    Rng rng(23);
+    std::map<int, int> m = random_map(rng, 30000, 100000);
+    Tree t = tree_of<Tree>(m);
+    const Tree& c = t;
+    for (int n : {0, 1, 7, 16, 17, 100, 5000}) {
+        std::vector<int> keys;
+        for (int i = 0; i < n; ++i) {
+            keys.push_back(pick(rng, 100000));
+        }
+        std::vector<int*> found(keys.size());
+        std::vector<const int*> seen(keys.size());
+        std::size_t hits = t.find_batch(keys.begin(), keys.end(), found.begin());
+        CHECK(c.find_batch(keys.begin(), keys.end(), seen.begin()) == hits);
+        std::size_t expected = 0;
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            auto mt = m.find(keys[i]);
+            expected += mt != m.end();
+            CHECK(mt == m.end() ? found[i] == nullptr : found[i] && *found[i] == mt->second);
+            CHECK(seen[i] == found[i]);
+        }
+        CHECK(hits == expected);
+    }
+}
+
+// SETS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// the key only tree against std::set
+static void test_set() {
+    Rng rng(3);
+    Red_black_set<int> t;
+    std::set<int> s;
+    for (int b = 0; b < batches; ++b) {
+        for (int i = 0; i < batch_ops; ++i) {
+            int k = pick(rng, key_range);
+            if (pick(rng, 3)) {
+                t.insert(k);
+                s.insert(k);
+            } else {
+                CHECK(t.remove(k) == (s.erase(k) == 1));
+            }
+        }
+        CHECK(t.validate());
+        CHECK(same_keys(t, s));
+        for (int i = 0; i < 100; ++i) {
+            int k = pick(rng, key_range);
+            CHECK(t.contains(k) == (s.count(k) == 1));
+        }
+    }
+
+    // printed with keys only
+    Red_black_set<int> small;
+    for (int k : {2, 1, 3}) {
+        small.insert(k);
+    }
+    CHECK(small.to_string(Red_black_set<int>::INORDER) == "[[NIL,(1),NIL],(2),[NIL,(3),NIL]]");
+}
+
+// COPIES AND MOVES ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Shared: handed to trees as a borrowed pointer
+struct Shared {
+    int id;
+};
+
+template <> struct Ownership<Shared*> : Borrowed_pointer<Shared*> {};
+
+// copies, clones, moves and swaps are independent of the original
+static void test_clone() {
+    Rng rng(12);
+    for (int n : {0, 1, 5, 1000, 50000}) {
+        std::map<int, int> m = random_map(rng, n, 1000000);
+        Tree t = tree_of<Tree>(m);
+        for (unsigned threads : {1u, 4u}) {
+            Tree c = t.clone(threads);
+            CHECK(c.validate() && same(c, m));
+            CHECK(c.height() == t.height() && c.black_height() == t.black_height());
+            c.insert(-1, -1);
+            c.remove(m.empty() ? 0 : m.begin()->first);
+            CHECK(same(t, m));
+        }
+        Tree copy(t);
+        CHECK(copy.validate() && same(copy, m));
+        Tree assigned;
+        assigned.insert(7, 7);
+        assigned = t;
+        CHECK(assigned.validate() && same(assigned, m));
+        assigned.clear();
+        CHECK(same(t, m) && same(copy, m));
+
+        Tree moved(std::move(copy));
+        CHECK(moved.validate() && same(moved, m));
+        CHECK(copy.validate() && copy.begin() == copy.end());
+        copy.insert(3, 3);
+        CHECK(copy.validate() && copy.contains(3));
+
+        Tree other;
+        other.insert(1, 2);
+        swap(other, moved);
+        CHECK(same(other, m) && moved.contains(1) && moved.validate());
+        moved = std::move(other);
+        CHECK(same(moved, m) && moved.validate());
+    }
+
+    // borrowed pointers are copied as they are, owned ones cannot be (a
+    // copy of a Red_black_tree<int, Tracked*> does not compile), they only
+    // move and swap
+    std::vector<Shared> shared(1000);
+    Red_black_tree<int, Shared*> borrowed;
+    for (int k = 0; k < 1000; ++k) {
+        shared[k].id = k;
+        borrowed.insert(k, &shared[k]);
+    }
+    for (unsigned threads : {1u, 4u}) {
+        Red_black_tree<int, Shared*> c = borrowed.clone(threads);
+        CHECK(c.validate() && *c.find(500) == &shared[500]);
+    }
+    {
+        Red_black_tree<int, Tracked*> owned;
+        for (int k = 0; k < 1000; ++k) {
+            owned.insert(k, new Tracked(k));
+        }
+        Red_black_tree<int, Tracked*> moved(std::move(owned));
+        Red_black_tree<int, Tracked*> other;
+        other.insert(-1, new Tracked(-1));
+        swap(other, moved);
+        owned = std::move(moved);
+        CHECK(owned.validate() && other.validate() && Tracked::live == 1001);
+        CHECK((*owned.find(-1))->id == -1 && (*other.find(999))->id == 999);
+    }
+    CHECK(Tracked::live == 0);
+}
+
+// a moved from tree has no arena until it needs one, joins, splits and
+// the set algebra included
+static void test_moved_from() {
+    Rng rng(18);
+    std::map<int, int> m = random_map(rng, 3000);
+    std::vector<std::pair<int, int>> v(m.begin(), m.end());
+    for (unsigned threads : {1u, 4u}) {
+        Tree a = tree_of<Tree>(m);
+        Tree keep(std::move(a));
+        Tree greater;
+        for (int k = key_range; k < key_range + 100; ++k) {
+            greater.insert(k, k);
+        }
+        a.join(greater); // a moved from tree consumes another one
+        CHECK(a.validate() && a.min_key() == key_range);
+
+        Tree b(std::move(keep));
+        Tree lesser;
+        lesser.join(keep); // and is consumed
+        CHECK(lesser.validate() && lesser.begin() == lesser.end());
+        b.split(key_range / 2, keep); // and receives a split
+        CHECK(b.validate() && keep.validate());
+        CHECK(same(keep, std::map<int, int>(m.upper_bound(key_range / 2), m.end())));
+
+        Tree c(std::move(keep));
+        keep.split(10, c); // and is split
+        CHECK(keep.begin() == keep.end() && c.validate() && c.begin() == c.end());
+
+        Tree d(std::move(b));
+        Tree e = Tree::from_sorted(v.begin(), v.end());
+        b.union_with(e, threads);
+        CHECK(b.validate() && same(b, m));
+        Tree f(std::move(b));
+        Tree g = Tree::from_sorted(v.begin(), v.end());
+        g.union_with(b, threads);
+        g.intersect_with(f, threads);
+        g.difference_with(b, threads);
+        CHECK(g.validate() && same(g, m));
+        CHECK(same(d, std::map<int, int>(m.begin(), m.upper_bound(key_range / 2))));
+
+        Tree h(std::move(g));
+        CHECK(g.insert_batch(v.begin(), v.end(), threads) == m.size());
+        CHECK(g.validate() && same(g, m));
+    }
+}
+
+// MAIN ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+struct Test {
+    const char* name;
+    void (*run)();
+};
+
+int main(int argc, char** argv) {
+    const Test tests[] = {
+        {"arena", test_arena},
+        {"insert", test_insert},
+        {"iterators", test_iterators},
+        {"from_sorted", test_from_sorted},
+        {"join_split", test_join_split},
+        {"set_algebra", test_set_algebra},
+        {"shared_blocks", test_shared_blocks},
+        {"emplace", test_emplace},
+        {"lookups", test_lookups},
+        {"concurrent", test_concurrent},
+        {"persistent", test_persistent},
+        {"order_statistics", test_order_statistics},
+        {"aggregates", test_aggregates},
+        {"intervals", test_intervals},
+        {"snapshot", test_snapshot},
+        {"text_output", test_text_output},
+        {"batches", test_batches},
+        {"shape", test_shape},
+        {"frozen", test_frozen},
+        {"sharded", test_sharded},
+        {"teardown", test_teardown},
+        {"ownership", test_ownership},
+        {"hinted", test_hinted},
+        {"removal", test_removal},
+        {"pop", test_pop},
+        {"find_batch", test_find_batch},
+        {"set", test_set},
+        {"clone", test_clone},
+        {"moved_from", test_moved_from},
+    };
+    std::string filter = argc > 1 ? argv[1] : "";
+    for (const Test& test : tests) {
+        if (std::string(test.name).find(filter) == std::string::npos) {
+            continue;
+        }
+        int before = failures;
+        test.run();
+        std::printf("%-20s %s\n", test.name, failures == before ? "ok" : "FAILED");
+    }
+    return failures == 0 ? 0 : 1;
+}